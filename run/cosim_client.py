@@ -0,0 +1,73 @@
+import socket
+import struct
+import sys
+
+##################################################
+#          Co-Simulation Client Stand-In         #
+##################################################
+# Plays the part of the depot controller test bench: sends a power setpoint
+# every step and prints the state published by cosim_daemon.py
+MSG_SETPOINT  = 0x01
+MSG_TELEMETRY = 0x02
+MSG_SHUTDOWN  = 0x03
+MSG_STATE     = 0x81
+MSG_ERROR     = 0xFF
+
+
+def send_msg(sock, msgType, payload=b''):
+    sock.sendall(struct.pack('<BxxxI', msgType, len(payload)) + payload)
+
+
+def recv_exact(sock, length):
+    data = b''
+    while len(data) < length:
+        chunk = sock.recv(length - len(data))
+        if not chunk:
+            raise IOError('Server closed the connection')
+        data += chunk
+    return data
+
+
+def recv_state(sock):
+    msgType, length = struct.unpack('<BxxxI', recv_exact(sock, 8))
+    payload = recv_exact(sock, length)
+    if msgType != MSG_STATE:
+        raise IOError('Unexpected message type %d' % msgType)
+
+    simTime, power, numChargers = struct.unpack_from('<idI', payload, 0)
+    offset = 16
+    chargers = {}
+    for _ in range(numChargers):
+        chrgrId, numPlugTypes = struct.unpack_from('<iB', payload, offset)
+        offset += 5
+        plugs = {}
+        for _ in range(numPlugTypes):
+            plugType, inUse = struct.unpack_from('<BH', payload, offset)
+            plugs[plugType] = inUse
+            offset += 3
+        chargers[chrgrId] = plugs
+
+    numBuses, = struct.unpack_from('<I', payload, offset)
+    offset += 4
+    buses = {}
+    for _ in range(numBuses):
+        busId, soc, busPower = struct.unpack_from('<iff', payload, offset)
+        buses[busId] = (soc, busPower)
+        offset += 12
+
+    return {'simTime': simTime, 'power': power, 'chargers': chargers, 'buses': buses}
+
+
+if __name__ == '__main__':
+    socketPath = sys.argv[1] if len(sys.argv) > 1 else '/tmp/ebusify.sock'
+    setpoint   = float(sys.argv[2]) if len(sys.argv) > 2 else 2000.0 # kW
+    numSteps   = int(sys.argv[3]) if len(sys.argv) > 3 else 60
+
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(socketPath)
+    for step in range(numSteps):
+        send_msg(sock, MSG_SETPOINT, struct.pack('<id', 16200 + step*60, setpoint))
+        state = recv_state(sock)
+        print("%d: %.1f kW, %d buses" % (state['simTime'], state['power'], len(state['buses'])))
+    send_msg(sock, MSG_SHUTDOWN)
+    sock.close()
@@ -0,0 +1,27 @@
+from model_runner import init_busManager
+from file_parser import parse_files
+import sys
+
+##################################################
+#               Co-Simulation Daemon             #
+##################################################
+# Serves the bus manager on a unix socket, see src/cosim_server.hpp for the
+# message format and run/cosim_client.py for a client stand-in.
+socketPath      = sys.argv[1] if len(sys.argv) > 1 else '/tmp/ebusify.sock'
+busMan_mode     = 1  # Smart charging, setpoints are the power request
+maxStepsPerPoll = 60 # Steps taken before the socket is checked again
+
+
+inFile_allFiles = {
+    'solarWind': '../resrc/other/solar_wind_basecase.csv',
+    'utilSources': '../resrc/other/source_info.csv',
+    'nonBusConsump': '../resrc/other/non_bus_consump.csv',
+    'chargerInfo': '../resrc/other/charger_info.csv',
+    'busCapacities': '../resrc/other/bus_capacities.csv',
+    'busSchedule': '../resrc/other/bus_charge_schedule.csv'
+}
+inFile_data = parse_files(inFile_allFiles)
+
+CapMetro = init_busManager({}, inFile_data)
+print("Serving on " + socketPath)
+CapMetro.serve(socketPath, busMan_mode, maxStepsPerPoll)
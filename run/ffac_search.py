@@ -0,0 +1,89 @@
+from model_runner import ModelRun
+import math
+
+##################################################
+#             Filter Factor Search               #
+##################################################
+# Golden-section search over the filter factor. Candidates are stepped side by
+# side and their cumulative cost is checked every checkpointSteps minutes,
+# since the utility cost only ever grows a candidate is dropped as soon as its
+# partial cost passes the best complete run.
+
+invPhi = (math.sqrt(5) - 1) / 2
+
+
+def run_candidates(ffacs, modelSettings, inFile_data, bestCost, checkpointSteps):
+    """Returns {ffac: total cost}, pruned and infeasible candidates cost inf"""
+    costs = {}
+    runs  = {}
+    traceSource = None
+    for ffac in ffacs:
+        settings = dict(modelSettings)
+        settings['filtfactor'] = ffac
+        runs[ffac] = ModelRun(settings, inFile_data, traceSource)
+        if (traceSource is None):
+            traceSource = runs[ffac].AustinEnergy
+
+    numSteps = min(run.numSteps for run in runs.values())
+    for idx in range(numSteps):
+        for ffac in list(runs.keys()):
+            run = runs[ffac]
+            run.step(idx)
+
+            if (run.is_infeasible()):
+                print("Filter Factor " + str(ffac) + ": infeasible at step " + str(idx))
+                costs[ffac] = float('inf')
+                del runs[ffac]
+            elif ((idx+1) % checkpointSteps == 0 and bestCost is not None and run.get_cost() > bestCost):
+                print("Filter Factor " + str(ffac) + ": pruned at step " + str(idx))
+                costs[ffac] = float('inf')
+                del runs[ffac]
+
+        if (not runs):
+            break
+
+    for ffac, run in runs.items():
+        costs[ffac] = run.get_cost()
+        print("Filter Factor " + str(ffac) + ": " + str(costs[ffac]))
+
+    return costs
+
+
+def search_filterFactor(modelSettings, inFile_data, lower, upper, tolerance, checkpointSteps=60):
+    """Returns (best filter factor, its cost, {ffac: cost} of every candidate run)"""
+    # Candidates are rounded so the search lands on the same grid as a sweep would
+    snapGrid = 0.001
+    def snap(ffac):
+        return round(ffac, 3)
+
+    # Snapped probes can not narrow the bracket much below the grid
+    tolerance = max(tolerance, 2*snapGrid)
+
+    a, b = lower, upper
+    c = snap(b - invPhi*(b - a))
+    d = snap(a + invPhi*(b - a))
+    evaluated = run_candidates([c, d], modelSettings, inFile_data, None, checkpointSteps)
+    fc, fd = evaluated[c], evaluated[d]
+
+    while (b - a) > tolerance:
+        probes = (c, d)
+        if (fc <= fd):
+            b, d, fd = d, c, fc
+            c = snap(b - invPhi*(b - a))
+            if (c not in evaluated):
+                evaluated.update(run_candidates([c], modelSettings, inFile_data, fd, checkpointSteps))
+            fc = evaluated[c]
+        else:
+            a, c, fc = c, d, fd
+            d = snap(a + invPhi*(b - a))
+            if (d not in evaluated):
+                evaluated.update(run_candidates([d], modelSettings, inFile_data, fc, checkpointSteps))
+            fd = evaluated[d]
+
+        # Snapping put the probes back where they were, the bracket will not shrink further
+        if ((c, d) == probes):
+            break
+
+    best = min(evaluated, key=evaluated.get)
+
+    return best, evaluated[best], evaluated
@@ -1,5 +1,51 @@
 import pandas as pd
+import numpy as np
 import datetime
+import os
+
+def parse_gtfs(gtfsDir, tripIds, elevFile = None):
+    """Stop coordinates and the ordered stops of each trip in tripIds, trip index follows tripIds"""
+    stopTimesFile = os.path.join(gtfsDir, 'stop_times.txt')
+    if not os.path.exists(stopTimesFile):
+        print("No stop_times.txt in " + gtfsDir + ", trips take their whole energy at departure")
+        return None
+
+    df_stops = pd.read_csv(os.path.join(gtfsDir, 'stops.txt'), dtype={'stop_id': str})
+    stopIdx = dict(zip(df_stops['stop_id'], range(len(df_stops))))
+
+    # GTFS has no elevation, terrain comes from a separate stop_id,elevation_m file when given
+    stopElevs = np.zeros(len(df_stops))
+    if elevFile is not None:
+        df_elevs = pd.read_csv(elevFile, dtype={'stop_id': str})
+        for stopId, elev in zip(df_elevs['stop_id'], df_elevs['elevation_m']):
+            if stopId in stopIdx:
+                stopElevs[stopIdx[stopId]] = elev
+
+    df_trips = pd.read_csv(os.path.join(gtfsDir, 'trips.txt'), dtype={'trip_id': str})
+    knownTrips = set(df_trips['trip_id'])
+    tripIdx = dict((tripId, idx) for idx, tripId in enumerate(tripIds) if tripId in knownTrips)
+
+    df_stopTimes = pd.read_csv(stopTimesFile, dtype={'trip_id': str, 'stop_id': str},
+                               usecols=['trip_id', 'stop_id', 'stop_sequence'])
+    df_stopTimes = df_stopTimes[df_stopTimes['trip_id'].isin(tripIdx)]
+    tripStops = dict((tripId, []) for tripId in tripIds)
+    for tripId, group in df_stopTimes.sort_values(['trip_id', 'stop_sequence']).groupby('trip_id'):
+        tripStops[tripId] = [stopIdx[stopId] for stopId in group['stop_id']]
+
+    tripOffsets = [0]
+    allStops = []
+    for tripId in tripIds:
+        allStops.extend(tripStops[tripId])
+        tripOffsets.append(len(allStops))
+
+    return {
+        'stopLats': df_stops['stop_lat'].astype('double').values,
+        'stopLons': df_stops['stop_lon'].astype('double').values,
+        'stopElevs': stopElevs,
+        'tripOffsets': np.array(tripOffsets, dtype=np.int32),
+        'tripStops': np.array(allStops, dtype=np.int32)
+    }
+
 
 def parse_files(allFiles, movMeanWindow = 10, autoAddPlugs = False):
 
@@ -57,6 +103,15 @@ def parse_files(allFiles, movMeanWindow = 10, autoAddPlugs = False):
         'rampCosts': rampCosts.values,
         'startCosts': startCosts.values
     }
+
+    # Plant types beyond the built in ones, or new emission rates for them, as rows of
+    # Type, CO2, CH4, N2O per MWh and Uncontrolled for types that follow the solar or wind trace
+    fuelTypes_data = []
+    if 'fuelTypes' in allFiles:
+        df_fuelTypes = pd.read_csv(allFiles['fuelTypes'])
+        for idx, row in df_fuelTypes.iterrows():
+            fuelTypes_data.append((str(row['Type']), float(row['CO2']), float(row['CH4']),
+                                   float(row['N2O']), bool(row['Uncontrolled'])))
     
     df_nonBusConsump = pd.read_csv(allFiles['nonBusConsump'])
 
@@ -100,6 +155,19 @@ def parse_files(allFiles, movMeanWindow = 10, autoAddPlugs = False):
         'schedChrgrIds': schedChrgrIds.values
     }
 
+    # Trips run after each charge are optional, they need a GTFS feed with stop_times.txt
+    routeEnergy_data = None
+    if 'gtfs' in allFiles and 'trip_ID' in df_busSchedule.columns:
+        schedTripIds = df_busSchedule['trip_ID'].fillna('').astype(str)
+        tripIds = sorted(set(schedTripIds) - set(['']))
+        routeEnergy_data = parse_gtfs(allFiles['gtfs'], tripIds, allFiles.get('stopElevations'))
+        if routeEnergy_data is not None:
+            # Trips missing from stop_times.txt or with a single stop have no segments to drain,
+            # buses on them take their distance at departure as before
+            offsets = routeEnergy_data['tripOffsets']
+            tripIdx = dict((tripId, idx) for idx, tripId in enumerate(tripIds) if offsets[idx+1] - offsets[idx] >= 2)
+            busSchedule_data['schedTripIdxs'] = np.array([tripIdx.get(tripId, -1) for tripId in schedTripIds], dtype=np.int32)
+
     df_chargerInfo = pd.read_csv(allFiles['chargerInfo'])
     chrgrIds  = df_chargerInfo['chrg_ID'].astype('int32')
     chrgrName = df_chargerInfo['chrg_name'].astype('string')
@@ -137,8 +205,10 @@ def parse_files(allFiles, movMeanWindow = 10, autoAddPlugs = False):
     return {
         'utilSolarWind': utilSolarWind_data,
         'utilSources': utilSources_data,
+        'fuelTypes': fuelTypes_data,
         'nonBusConsump': df_nonBusConsump['Non-Bus Consumption (MW)'].astype('double').values,
         'chargerInfo': chargerInfo_data,
         'busCapacities': busCapacities_data,
         'busSchedule': busSchedule_data,        
+        'routeEnergy': routeEnergy_data,
     }
\ No newline at end of file
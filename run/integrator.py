@@ -1,4 +1,5 @@
 from model_runner import run_model
+from ffac_search import search_filterFactor
 from file_parser import parse_files
 import matplotlib.pyplot as plt
 import pandas as pd
@@ -17,6 +18,10 @@ ffac_rangeStep  = 0.01
 ffac_range      = [x/1000 for x in np.arange(start=ffac_rangeBegin*1000, stop=(ffac_rangeEnd+ffac_rangeStep)*1000, step=ffac_rangeStep*1000)]
 ffac_useMovMean = False
 ffac_movMeanWin = 5
+ffac_stopInfeasible = True # Stop a sweep run once a bus is stranded or a solve is infeasible
+ffac_searchMode = 'grid'   # 'grid' runs all of ffac_range, 'golden' searches the range for the cheapest
+ffac_searchTol  = 0.005    # Width of the range the golden search narrows down to
+ffac_checkpoint = 60       # Steps between cost checks, candidates above the best full run are dropped
 
 ##################################################
 #              Bus Manager Settings              #
@@ -26,6 +31,28 @@ ffac_movMeanWin = 5
 # 1 - Smart Charging
 # 2 - Diesel buses
 busMan_mode = 0
+busMan_eventDriven = False # Skip steps where no arrivals, departures or SoC limits occur
+busMan_numThreads  = 1     # Worker threads used to step chargers in parallel
+busMan_plugQueue   = False # Buses hold plugs across steps and wait in queue when none are free
+busMan_plugConnect = 0     # Seconds to connect a bus to a plug, no power flows meanwhile
+busMan_plugDiscon  = 0     # Seconds a plug stays busy after its bus leaves
+busMan_plugMaxPwr  = {}    # kW cap per plug type, 0 - SAEJ3105, 1 - EVA080K
+busMan_chrgrCaps   = {}    # kW cap per charger id on the total drawn at that site
+busMan_feederCaps  = {}    # Feeder id: (kW cap, [charger ids on the feeder])
+busMan_chrgCurves  = []    # ([bus ids], [SoC points], [fraction of rated power]), e.g. taper from 80% SoC:
+                           # (busIds, [0.0, 0.8, 1.0], [1.0, 1.0, 0.1])
+busMan_v2g         = False # Discharge only when v2g_value beats the pack wear it causes
+busMan_v2gValue    = 0.15  # $/kWh earned for energy discharged to the grid
+busMan_degradation = []    # ([bus ids], $/kWh pack cost, full depth cycle life, depth exponent)
+busMan_tariffChrg  = False # Charge in the cheapest hours before departure within site demand levels
+busMan_tariff      = None  # ([period starts in s of day], [$/kWh]), e.g. ([0, 25200, 61200, 75600], [0.05, 0.10, 0.25, 0.10])
+busMan_demandChrgs = {}    # Charger id: (kW threshold, $/kW on the peak above it)
+busMan_plannedChrg = False # Plan the day's charging once up front and replay it
+busMan_planSignal  = 'renewable' # Plan against 'renewable' output or 'tariff' prices
+busMan_gridSignal  = False # Charge flexible buses harder when the utility's marginal power is cheap and clean
+busMan_gridWeights = (0.5, 0.5) # Weights of marginal cost and marginal CO2 in the grid signal
+busMan_routeModel  = {}    # Overrides of cruise_speed (mph), dwell_time, stop_delay (s), stop_miles,
+                           # climb_miles (per m), regen_fraction and circuity for GTFS trip profiles
 avgBusPower = 130.605 * 60 / 1000  # MW
 
 
@@ -38,13 +65,15 @@ inFile_nonBusConsump = '../resrc/other/non_bus_consump.csv'
 inFile_chargerInfo   = '../resrc/other/charger_info.csv'
 inFile_busCapacities = '../resrc/other/bus_capacities.csv'
 inFile_busSchedule   = '../resrc/other/bus_charge_schedule.csv'
+inFile_gtfs          = '../resrc/capmetro'  # Used for schedule rows with a trip_ID
 inFile_allFiles = {
     'solarWind': inFile_solarWind,
     'utilSources': inFile_utilSources,
     'nonBusConsump': inFile_nonBusConsump,
     'chargerInfo': inFile_chargerInfo,
     'busCapacities': inFile_busCapacities,
-    'busSchedule': inFile_busSchedule
+    'busSchedule': inFile_busSchedule,
+    'gtfs': inFile_gtfs
 }
 inFile_data = parse_files(inFile_allFiles, ffac_movMeanWin)
 
@@ -54,8 +83,29 @@ inFile_data = parse_files(inFile_allFiles, ffac_movMeanWin)
 ##################################################
 modelSettings = {
     'busMan_mode': busMan_mode,
+    'event_driven': busMan_eventDriven,
+    'num_threads': busMan_numThreads,
+    'plug_queue': busMan_plugQueue,
+    'plug_connectTime': busMan_plugConnect,
+    'plug_disconnectTime': busMan_plugDiscon,
+    'plug_maxPower': busMan_plugMaxPwr,
+    'charger_caps': busMan_chrgrCaps,
+    'feeder_caps': busMan_feederCaps,
+    'charge_curves': busMan_chrgCurves,
+    'route_model': busMan_routeModel,
+    'v2g': busMan_v2g,
+    'v2g_value': busMan_v2gValue,
+    'degradation': busMan_degradation,
+    'tariff_charge': busMan_tariffChrg,
+    'tariff': busMan_tariff,
+    'demand_charges': busMan_demandChrgs,
+    'planned_charge': busMan_plannedChrg,
+    'plan_signal': busMan_planSignal,
+    'grid_signal': busMan_gridSignal,
+    'grid_weights': busMan_gridWeights,
     'use_movMean': ffac_useMovMean,
-    'avg_busPower': avgBusPower
+    'avg_busPower': avgBusPower,
+    'stop_onInfeasible': ffac_runOpt and ffac_stopInfeasible
 }
 
 
@@ -65,13 +115,17 @@ modelSettings = {
 cwd = os.getcwd()
 source = cwd + "/output/"
 
-if ffac_runOpt and not ffac_useMovMean:
+if ffac_runOpt and not ffac_useMovMean and ffac_searchMode == 'grid':
     totalCost = []
     for ffac in ffac_range:
         modelSettings['filtfactor'] = ffac
         modelOutput = run_model(modelSettings, inFile_data)
 
-        totalCost.append(modelOutput['totalCost'])
+        # Costs of runs stopped early are not comparable
+        if modelOutput['infeasible']:
+            totalCost.append(float('nan'))
+        else:
+            totalCost.append(modelOutput['totalCost'])
 
         time = range(len(modelOutput['busPwrTime']))
         result = map(float.__sub__, modelOutput['busTrgtPwrTime'], modelOutput['busPwrTime'])
@@ -107,6 +161,17 @@ if ffac_runOpt and not ffac_useMovMean:
     plt.show()
 
 else:
+    if ffac_runOpt and not ffac_useMovMean and ffac_searchMode == 'golden':
+        ffac_statFac, bestCost, evaluated = search_filterFactor(modelSettings, inFile_data,
+                                                ffac_rangeBegin, ffac_rangeEnd, ffac_searchTol, ffac_checkpoint)
+        print("Best Filter Factor: " + str(ffac_statFac) + " (" + str(len(evaluated)) + " candidates)")
+
+        ff_index = pd.Series(data=sorted(evaluated), name='Filter Factors')
+        df_filterFactorCost = pd.Series(data=[evaluated[f] for f in sorted(evaluated)], name='Total Cost').to_frame()
+        df_filterFactorCost.set_index(ff_index, inplace=True)
+        df_filterFactorCost.to_csv('output/FilterFactorCost.csv')
+
+    # The chosen filter factor is run once more in full to write its outputs
     modelSettings['filtfactor'] = ffac_statFac
     modelOutput = run_model(modelSettings, inFile_data)
 
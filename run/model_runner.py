@@ -1,28 +1,16 @@
 import UtilityManager
 import BusManager
 import numpy as np
+import threading
+import copy
 
-def run_model(model_settings, inFile_data):
-
-    ##################################################
-    #          Initializing Utility Manager          #
-    ##################################################
-    AustinEnergy = UtilityManager.UtilityManager()
-    AustinEnergy.init(inFile_data['utilSources']['names'],
-                    inFile_data['utilSources']['types'],
-                    inFile_data['utilSources']['maxCaps'],
-                    inFile_data['utilSources']['minCaps'],
-                    inFile_data['utilSources']['runCosts'],
-                    inFile_data['utilSources']['rampRates'],
-                    inFile_data['utilSources']['rampCosts'],
-                    inFile_data['utilSources']['startCosts'],
-                    inFile_data['utilSolarWind']['solar'],
-                    inFile_data['utilSolarWind']['wind'])
+def init_busManager(model_settings, inFile_data):
 
     ##################################################
     #            Initializing Bus Manager            #
     ##################################################
     CapMetro = BusManager.BusManager()
+    CapMetro.set_numThreads(model_settings.get('num_threads', 1))
     CapMetro.init_chargers(inFile_data['chargerInfo']['chrgrIds'],
                         inFile_data['chargerInfo']['chrgrName'],
                         inFile_data['chargerInfo']['numPlugs'],
@@ -42,82 +30,267 @@ def run_model(model_settings, inFile_data):
                         inFile_data['busSchedule']['distNextChrg'],
                         inFile_data['busSchedule']['schedChrgrIds'])
 
-    busPwrTime     = []
-    busTrgtPwrTime = []
-    fltPwrTime     = []
-    renewPwrTime   = []
-    useMovMean = model_settings['use_movMean']
-    busManagerMode = model_settings['busMan_mode']
-    avgBusPower = model_settings['avg_busPower']
-    fltrFactor = model_settings['filtfactor']
-    print("\n\nFilter Factor: " + str(fltrFactor))
-    
-    for idx, power in enumerate(inFile_data['nonBusConsump']):
-        solar = inFile_data['utilSolarWind']['solar'][idx]
-        wind = inFile_data['utilSolarWind']['wind'][idx]
-        sw_movmean = inFile_data['utilSolarWind']['solar_mm'][idx] \
-                   + inFile_data['utilSolarWind']['wind_mm'][idx]
+    # Plug overheads and limits only take effect when plugs are queued
+    CapMetro.set_plugOverheads(model_settings.get('plug_connectTime', 0),
+                        model_settings.get('plug_disconnectTime', 0))
+    for plugType, maxPower in model_settings.get('plug_maxPower', {}).items():
+        CapMetro.set_maxPlugPower(plugType, maxPower)
+
+    # Site and feeder limits in kW, feeders are given as (cap, [charger ids])
+    for chargerId, maxPower in model_settings.get('charger_caps', {}).items():
+        CapMetro.set_chargerCap(chargerId, maxPower)
+    for feederId, (maxPower, chargerIds) in model_settings.get('feeder_caps', {}).items():
+        CapMetro.set_feederCap(feederId, maxPower, np.array(chargerIds, dtype=np.int32))
+
+    # Taper curves as ([bus ids], [SoC points], [fraction of rated charge power])
+    for busIds, socPoints, powerFactors in model_settings.get('charge_curves', []):
+        CapMetro.set_chargeCurve(np.array(busIds, dtype=np.int32),
+                        np.array(socPoints, dtype=np.float64),
+                        np.array(powerFactors, dtype=np.float64))
+
+    # Pack wear as ([bus ids], $/kWh pack cost, full depth cycle life, depth exponent)
+    for busIds, packCost, cycleLife, wearExponent in model_settings.get('degradation', []):
+        CapMetro.set_degradation(np.array(busIds, dtype=np.int32), packCost, cycleLife, wearExponent)
+    CapMetro.set_v2gValue(model_settings.get('v2g_value', 0.15))
+
+    # Time of use prices as ([period starts in s of day], [$/kWh]), demand charges per charger id
+    if model_settings.get('tariff'):
+        periodStarts, prices = model_settings['tariff']
+        CapMetro.set_tariff(np.array(periodStarts, dtype=np.int32), np.array(prices, dtype=np.float64))
+    for chargerId, (threshold, charge) in model_settings.get('demand_charges', {}).items():
+        CapMetro.set_demandCharge(chargerId, threshold, charge)
+
+    # Trip energy profiles, route_model overrides the speed, stop and terrain model defaults
+    routeEnergy = inFile_data.get('routeEnergy')
+    if routeEnergy is not None:
+        routeModel = model_settings.get('route_model', {})
+        CapMetro.set_routeModel(routeModel.get('cruise_speed', 12.0),
+                        routeModel.get('dwell_time', 20.0),
+                        routeModel.get('stop_delay', 15.0),
+                        routeModel.get('stop_miles', 0.03),
+                        routeModel.get('climb_miles', 0.02),
+                        routeModel.get('regen_fraction', 0.6),
+                        routeModel.get('circuity', 1.25))
+        CapMetro.init_routeEnergy(routeEnergy['stopLats'],
+                        routeEnergy['stopLons'],
+                        routeEnergy['stopElevs'],
+                        routeEnergy['tripOffsets'],
+                        routeEnergy['tripStops'])
+        tripIdxs = inFile_data['busSchedule']['schedTripIdxs']
+        assigned = tripIdxs >= 0
+        CapMetro.assign_trips(inFile_data['busSchedule']['schedBusIds'][assigned],
+                        inFile_data['busSchedule']['chargeEnds'][assigned],
+                        tripIdxs[assigned])
+
+    return CapMetro
+
+
+def init_utilityManager(inFile_data, traceSource=None):
+
+    ##################################################
+    #          Initializing Utility Manager          #
+    ##################################################
+    # Managers built from traceSource share its solar and wind traces instead of copying them
+    AustinEnergy = UtilityManager.UtilityManager()
+    for fuelType in inFile_data.get('fuelTypes', []):
+        AustinEnergy.set_fuelType(*fuelType)
+    sources = inFile_data['utilSources']
+    if (traceSource is None):
+        AustinEnergy.init(sources['names'], sources['types'], sources['maxCaps'], sources['minCaps'],
+                          sources['runCosts'], sources['rampRates'], sources['rampCosts'], sources['startCosts'],
+                          inFile_data['utilSolarWind']['solar'],
+                          inFile_data['utilSolarWind']['wind'])
+    else:
+        AustinEnergy.init(sources['names'], sources['types'], sources['maxCaps'], sources['minCaps'],
+                          sources['runCosts'], sources['rampRates'], sources['rampCosts'], sources['startCosts'])
+        AustinEnergy.share_traces(traceSource)
+
+    return AustinEnergy
+
+
+def get_planSignal(model_settings, inFile_data, numSteps):
+    """Price per minute from 16200 for the planner, tariff prices or the renewable output negated"""
+    if model_settings.get('plan_signal', 'renewable') == 'tariff' and model_settings.get('tariff'):
+        periodStarts, prices = model_settings['tariff']
+        timeOfDay = (16200 + np.arange(numSteps)*60) % 86400
+        return np.array(prices, dtype=np.float64)[np.searchsorted(periodStarts, timeOfDay, side='right') - 1]
+
+    renewable = inFile_data['utilSolarWind']['solar'][:numSteps] + inFile_data['utilSolarWind']['wind'][:numSteps]
+    return -np.asarray(renewable, dtype=np.float64)
 
-        if (idx == 0):
-            if (busManagerMode < 2):
-                # Calculate filtered power
-                if (useMovMean):
-                    fltrPower = sw_movmean
-                else:
-                    fltrPower = solar + wind
-                renewPwrTime.append(solar + wind)
-                fltPwrTime.append(fltrPower)
-
-                # Find difference between power and filtered power, 
-                # bus manager will attempt to absorb(+) or provide(-) this
-                busTargetPower = avgBusPower + (solar + wind) - fltrPower
-                busTrgtPwrTime.append(busTargetPower)
-
-                busPower = CapMetro.run(busTargetPower*1000, busManagerMode, 16200 + (idx*60))
-                busPwrTime.append(busPower/1000)
 
+class ModelRun(object):
+    """One scenario stepped a minute at a time so several can run side by side"""
+
+    def __init__(self, model_settings, inFile_data, traceSource=None):
+        self.inFile_data  = inFile_data
+        self.AustinEnergy = init_utilityManager(inFile_data, traceSource)
+        self.CapMetro     = init_busManager(model_settings, inFile_data)
+        self.numSteps     = len(inFile_data['nonBusConsump'])
+        self.stepsRun     = 0
+
+        self.busPwrTime     = []
+        self.busTrgtPwrTime = []
+        self.fltPwrTime     = []
+        self.renewPwrTime   = []
+        self.useMovMean = model_settings['use_movMean']
+        self.busManagerMode = model_settings['busMan_mode']
+        self.busRunMode = self.busManagerMode
+        if (model_settings.get('event_driven', False)):
+            self.busRunMode |= 0x04
+        if (model_settings.get('plug_queue', False)):
+            self.busRunMode |= 0x08
+        if (model_settings.get('v2g', False)):
+            self.busRunMode |= 0x02
+        if (model_settings.get('tariff_charge', False)):
+            self.busRunMode |= 0x10
+        self.planStats = None
+        if (model_settings.get('planned_charge', False)):
+            self.busRunMode |= 0x20
+            self.planStats = self.CapMetro.plan_charging(get_planSignal(model_settings, inFile_data, self.numSteps), 16200)
+        # The bus manager reads the utility's marginal cost and CO2 directly each step
+        self.gridWeights = model_settings.get('grid_weights', (0.5, 0.5))
+        if (model_settings.get('grid_signal', False)):
+            self.busRunMode |= 0x40
+        self.CapMetro.set_gridSignal(self.AustinEnergy.get_gridSignal(), *self.gridWeights)
+        self.avgBusPower = model_settings['avg_busPower']
+        self.fltrFactor = model_settings['filtfactor']
+        self.fltrPower = 0
+
+    def step(self, idx):
+        power = self.inFile_data['nonBusConsump'][idx]
+        solar = self.inFile_data['utilSolarWind']['solar'][idx]
+        wind = self.inFile_data['utilSolarWind']['wind'][idx]
+        sw_movmean = self.inFile_data['utilSolarWind']['solar_mm'][idx] \
+                   + self.inFile_data['utilSolarWind']['wind_mm'][idx]
+
+        if (self.busManagerMode < 2):
+            # Calculate filtered power, the first step starts the filter at the raw value
+            if (self.useMovMean):
+                self.fltrPower = sw_movmean
+            elif (idx == 0):
+                self.fltrPower = solar + wind
             else:
-                busPower = 0
-                fltPwrTime.append(0)
-                busPwrTime.append(0)
-            
-            AustinEnergy.startup(power + busPower/1000)
+                self.fltrPower = (self.fltrFactor * self.fltrPower) + ((1-self.fltrFactor) * (solar + wind))
+            self.renewPwrTime.append(solar + wind)
+            self.fltPwrTime.append(self.fltrPower)
+
+            # Find difference between power and filtered power, 
+            # bus manager will attempt to absorb(+) or provide(-) this
+            busTargetPower = self.avgBusPower + (solar + wind) - self.fltrPower
+            self.busTrgtPwrTime.append(busTargetPower)
+
+            busPower = self.CapMetro.run(busTargetPower*1000, self.busRunMode, 16200 + (idx*60))
+            self.busPwrTime.append(busPower/1000)
 
         else:
-            if (busManagerMode < 2):
-                # Calculate filtered power
-                if (useMovMean):
-                    fltrPower = sw_movmean
-                else:
-                    fltrPower = (fltrFactor * fltrPower) + ((1-fltrFactor) * (solar + wind))
-                renewPwrTime.append(solar + wind)
-                fltPwrTime.append(fltrPower)
-                
-                # Find difference between power and filtered power, 
-                # bus manager will attempt to absorb(+) or provide(-) this
-                busTargetPower = avgBusPower + (solar + wind) - fltrPower
-                busTrgtPwrTime.append(busTargetPower)
-
-                busPower = CapMetro.run(busTargetPower*1000, busManagerMode, 16200 + (idx*60))
-                busPwrTime.append(busPower/1000)
+            busPower = 0
+            self.fltPwrTime.append(0)
+            self.busPwrTime.append(0)
 
-            else:
-                busPower = 0
-                fltPwrTime.append(0)
-                busPwrTime.append(0)
+        if (idx == 0):
+            self.AustinEnergy.startup(power + busPower/1000, busPower/1000)
+        else:
+            self.AustinEnergy.power_request(power + busPower/1000, busPower/1000)
+        self.stepsRun = idx + 1
+
+    def get_cost(self):
+        # Every step adds a non negative cost so this only grows as the run goes on
+        return self.AustinEnergy.get_totalCost()
+
+    def is_infeasible(self):
+        return self.CapMetro.is_infeasible() or self.AustinEnergy.is_infeasible()
+
+    def get_checkpoint(self):
+        # Manager blobs plus the filter and series kept on this side
+        return {
+            'busManager': self.CapMetro.get_checkpoint(),
+            'utilManager': self.AustinEnergy.get_checkpoint(),
+            'fltrPower': self.fltrPower,
+            'stepsRun': self.stepsRun,
+            'busPwrTime': list(self.busPwrTime),
+            'busTrgtPwrTime': list(self.busTrgtPwrTime),
+            'fltPwrTime': list(self.fltPwrTime),
+            'renewPwrTime': list(self.renewPwrTime)
+        }
 
-            AustinEnergy.power_request(power + busPower/1000)
+    def restore_checkpoint(self, checkpoint):
+        # Settings such as the filter factor are kept so variants can fork from one checkpoint
+        self.CapMetro.restore_checkpoint(checkpoint['busManager'])
+        self.AustinEnergy.restore_checkpoint(checkpoint['utilManager'])
+        self.fltrPower = checkpoint['fltrPower']
+        self.stepsRun = checkpoint['stepsRun']
+        self.busPwrTime = list(checkpoint['busPwrTime'])
+        self.busTrgtPwrTime = list(checkpoint['busTrgtPwrTime'])
+        self.fltPwrTime = list(checkpoint['fltPwrTime'])
+        self.renewPwrTime = list(checkpoint['renewPwrTime'])
+
+    def fork(self):
+        # Bus manager branches share chargers, schedule and history until they diverge,
+        # the utility has no shared state so it is rebuilt from a checkpoint
+        branch = copy.copy(self)
+        branch.CapMetro = self.CapMetro.fork()
+        branch.AustinEnergy = init_utilityManager(self.inFile_data, self.AustinEnergy)
+        branch.AustinEnergy.restore_checkpoint(self.AustinEnergy.get_checkpoint())
+        branch.CapMetro.set_gridSignal(branch.AustinEnergy.get_gridSignal(), *branch.gridWeights)
+        branch.busPwrTime = list(self.busPwrTime)
+        branch.busTrgtPwrTime = list(self.busTrgtPwrTime)
+        branch.fltPwrTime = list(self.fltPwrTime)
+        branch.renewPwrTime = list(self.renewPwrTime)
+
+        return branch
+
+    def finish(self, dumpFiles=True):
+        # Dump Information to files then clear manager objects
+        if (dumpFiles):
+            self.AustinEnergy.file_dump()
+            self.CapMetro.file_dump()
+
+        modelOutput = {
+            'totalCost': self.AustinEnergy.get_totalCost(),
+            'eventCounts': self.CapMetro.get_eventCounts(),
+            'infeasible': self.is_infeasible(),
+            'busFailures': self.CapMetro.get_failureCounts(),
+            'utilFailures': self.AustinEnergy.get_failureCounts(),
+            'plugStats': self.CapMetro.get_plugStats(),
+            'degradationStats': self.CapMetro.get_degradationStats(),
+            'tariffStats': self.CapMetro.get_tariffStats(),
+            'emissionsStats': self.AustinEnergy.get_emissionsStats(),
+            'gridStats': self.CapMetro.get_gridStats(),
+            'planStats': self.planStats,
+            'busPwrTime': self.busPwrTime,
+            'busTrgtPwrTime': self.busTrgtPwrTime,
+            'renewPwrTime': self.renewPwrTime,
+            'fltPwrTime': self.fltPwrTime
+        }
+
+        return modelOutput
+
+
+def advance_branches(runs, endStep):
+    # Managers release the GIL while stepping so every branch gets its own thread
+    def advance(run):
+        for idx in range(run.stepsRun, endStep):
+            run.step(idx)
+
+    threads = [threading.Thread(target=advance, args=(run,)) for run in runs]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+
+def run_model(model_settings, inFile_data):
+    stopOnInfeasible = model_settings.get('stop_onInfeasible', False)
+    print("\n\nFilter Factor: " + str(model_settings['filtfactor']))
 
-    # Dump Information to files then clear manager objects
-    AustinEnergy.file_dump()
-    CapMetro.file_dump()
+    model = ModelRun(model_settings, inFile_data)
+    for idx in range(model.numSteps):
+        model.step(idx)
 
-    modelOutput = {
-        'totalCost': AustinEnergy.get_totalCost(),
-        'busPwrTime': busPwrTime,
-        'busTrgtPwrTime': busTrgtPwrTime,
-        'renewPwrTime': renewPwrTime,
-        'fltPwrTime': fltPwrTime
-    }
+        # No point finishing a scenario that already can not run as planned
+        if (stopOnInfeasible and model.is_infeasible()):
+            print("Stopping infeasible scenario at step " + str(idx))
+            break
 
-    return modelOutput
+    return model.finish()
@@ -1,27 +1,34 @@
 #include "bus.hpp"
 #include "error.hpp"
 #include <math.h>
+#include <atomic>
 #include <iostream>
 
 namespace BUS {
 
-Bus::Bus(int id, double capacity, double consumptionRate, double chargeRate, double distFirstCharge, PlugType plugType)
+Bus::Bus(int id, BusModelPtr model, double distFirstCharge)
 :
     _identifier(id),
-    _capacity(capacity),
-    _consumptionRate(consumptionRate),
-    _chargeRate(chargeRate),
-    _distFirstCharge(distFirstCharge),
-    _minSoc(0.1),
-    _maxSoc(0.9),
-    _plugType(plugType)
+    _model(model),
+    _distFirstCharge(distFirstCharge)
 {
+    double consumptionRate = model->consumptionRate;
     _stateOfCharge = 0.5;
-    _stateOfCharge -= (distFirstCharge * consumptionRate)/capacity;
-    _socTime[16200] = _stateOfCharge;
-    _consumpChargerTime[16200] = 0.0;
-    _consumpRouteTime[16200] = distFirstCharge * consumptionRate;
+    _stateOfCharge -= (distFirstCharge * consumptionRate)/model->capacity;
+    _historyStart = 16200;
+    _historyInterval = 60;
+    _history.reset(new History());
+    _history->socTime.push_back(_stateOfCharge);
+    _history->consumpChargerTime.push_back(0.0);
+    _history->consumpRouteTime.push_back(distFirstCharge * consumptionRate);
     _lastTsRun = 16200;
+    _lastTsRecorded = false;
+    _lastChargePower = 0.0;
+    _holdPower = 0.0;
+    _trip = {-1, 0, 0, 0, 0.0};
+    _cycles.reset(_stateOfCharge);
+    _throughput = 0.0;
+    _cycleDamage = 0.0;
 }
 
 
@@ -33,6 +40,7 @@ int
 Bus::init_soc(double stateOfCharge)
 {
     _stateOfCharge = stateOfCharge;
+    _cycles.reset(stateOfCharge);
 
     return 0;
 }
@@ -41,74 +49,260 @@ Bus::init_soc(double stateOfCharge)
 int 
 Bus::command_power(double power, double timestep, int simTime, BUS::PowerType pt, bool force)
 {
-    // Fill in SoC for timesteps that bus was not commanded power
-    int tsDiff;
-    for (tsDiff = simTime - _lastTsRun - 60; tsDiff > 0; tsDiff-=60){
-        _socTime[simTime-tsDiff] = _socTime[_lastTsRun];
-        _consumpChargerTime[simTime-tsDiff] = 0.0;
-        _consumpRouteTime[simTime-tsDiff] = 0.0;
-    }
-
     double deltaEnergy, newSoc;
     deltaEnergy = power * timestep / 3600;
-    newSoc = _stateOfCharge + (deltaEnergy / _capacity);
-    if ( newSoc > _maxSoc && !force )
+    newSoc = _stateOfCharge + (deltaEnergy / _model->capacity);
+    if ( newSoc > _model->maxSoc && !force )
         return OVER_MAX_SOC;
-    else if ( newSoc < _minSoc && !force )
+    else if ( newSoc < _model->minSoc && !force )
         return UNDER_MIN_SOC;
 
+    _stateOfCharge = newSoc;
+    track_wear(deltaEnergy);
     switch( pt ){
         case PowerType::e_ATCHARGER:
-            _consumpChargerTime[simTime] = deltaEnergy;
-            _consumpRouteTime[simTime]   = 0.0;
+            record_history(simTime, deltaEnergy, 0.0);
+            _lastChargePower = power;
             break;
         case PowerType::e_ONROUTE:
-            _consumpChargerTime[simTime] = 0.0;
-            _consumpRouteTime[simTime]   = -deltaEnergy;
+            record_history(simTime, 0.0, -deltaEnergy);
+            _lastChargePower = 0.0;
             break;
         default:
-            _consumpChargerTime[simTime] = 0.0;
-            _consumpRouteTime[simTime]   = 0.0;
+            record_history(simTime, 0.0, 0.0);
+            _lastChargePower = 0.0;
             break;
     }
 
-    _stateOfCharge = newSoc;
-    _socTime[simTime] = _stateOfCharge;
     _lastTsRun = simTime;
     return 0;
 }
 
 
+Bus::History&
+Bus::own_history()
+{
+    // Forked managers share history until one of them writes to it
+    if ( _history.use_count() > 1 )
+        _history.reset(new History(*_history));
+    else
+        std::atomic_thread_fence(std::memory_order_acquire); // Pairs with the release of the last other owner
+
+    return *_history;
+}
+
+
+void
+Bus::record_history(int simTime, double chargerEnergy, double routeEnergy)
+{
+    int slot = get_historySlot(simTime);
+    int prevSlot = get_historySlot(_lastTsRun);
+    History& history = own_history();
+
+    if ( slot >= (int)history.socTime.size() ){
+        // Bus held its SoC and used no energy in the slots it was not commanded
+        double prevSoc = history.socTime.back();
+        history.socTime.resize(slot + 1, prevSoc);
+        history.consumpChargerTime.resize(slot + 1, 0.0);
+        history.consumpRouteTime.resize(slot + 1, 0.0);
+        history.consumpChargerTime[slot] = chargerEnergy;
+        history.consumpRouteTime[slot]   = routeEnergy;
+    }
+    else if ( slot == prevSlot && _lastTsRecorded ){
+        // Several steps fall into one decimated slot, or a step is commanded more than once.
+        // The first step still overwrites the distFirstCharge seed the constructor put in slot 0
+        history.consumpChargerTime[slot] += chargerEnergy;
+        history.consumpRouteTime[slot]   += routeEnergy;
+    }
+    else {
+        history.consumpChargerTime[slot] = chargerEnergy;
+        history.consumpRouteTime[slot]   = routeEnergy;
+    }
+    history.socTime[slot] = _stateOfCharge;
+    _lastTsRecorded = true;
+}
+
+
+int
+Bus::get_historySlot(int ts) const
+{
+    if ( ts < _historyStart )
+        return 0;
+
+    return (ts - _historyStart) / _historyInterval;
+}
+
+
+void
+Bus::settle(int simTime, int timestep)
+{
+    if ( _holdPower == 0.0 )
+        return;
+
+    // Apply the held power for every step up to simTime exactly as command_power would
+    double deltaEnergy = _holdPower * (double)timestep / 3600;
+    for (int ts = _lastTsRun + timestep; ts < simTime; ts+=timestep){
+        _stateOfCharge += (deltaEnergy / _model->capacity);
+        track_wear(deltaEnergy);
+        record_history(ts, deltaEnergy, 0.0);
+        _lastTsRun = ts;
+    }
+    _holdPower = 0.0;
+}
+
+
+void
+Bus::track_wear(double deltaEnergy)
+{
+    double exponent = _model->wearExponent, cycleLife = _model->cycleLife;
+    _throughput += fabs(deltaEnergy);
+    _cycles.add(_stateOfCharge, [&](double depth, double cycles){
+        _cycleDamage += cycles * pow(depth, exponent) / cycleLife;
+    });
+}
+
+
+double
+Bus::get_wearDamage() const
+{
+    double damage = _cycleDamage;
+    double exponent = _model->wearExponent, cycleLife = _model->cycleLife;
+    _cycles.get_residual([&](double depth, double cycles){
+        damage += cycles * pow(depth, exponent) / cycleLife;
+    });
+
+    return damage;
+}
+
+
+double
+Bus::get_wearCost(double energy) const
+{
+    // Priced as deepening the open excursion by a full cycle, the pack will be cycled back
+    double delta = energy / _model->capacity;
+    double depth = _cycles.get_openDepth(delta);
+    double damage = (pow(depth + fabs(delta), _model->wearExponent) - pow(depth, _model->wearExponent)) / _model->cycleLife;
+
+    return damage * _model->packCost * _model->capacity;
+}
+
+
+void
+Bus::start_trip(int tripIdx, int departTime, int timestep)
+{
+    _trip = {tripIdx, departTime, departTime - timestep, 0, 0.0};
+}
+
+
+double
+Bus::get_currentSoc(int simTime, int timestep) const
+{
+    double soc = _stateOfCharge;
+    if ( _holdPower == 0.0 )
+        return soc;
+
+    double deltaEnergy = _holdPower * (double)timestep / 3600;
+    for (int ts = _lastTsRun + timestep; ts <= simTime; ts+=timestep)
+        soc += (deltaEnergy / _model->capacity);
+
+    return soc;
+}
+
+
+double
+Bus::get_maxChargePower(int timestep) const
+{
+    double ratedPower = _model->chargeRate * 60; // kW
+    if ( !_model->chargeCurve )
+        return ratedPower;
+
+    return _model->chargeCurve->get_stepEnergy(_stateOfCharge, ratedPower, ratedPower, _model->capacity, timestep) * 3600 / timestep;
+}
+
+
+void
+Bus::save_state(CKPT::Writer& out) const
+{
+    out.put(_identifier);
+    out.put<int32_t>(_model->index);
+    out.put(_stateOfCharge);
+    out.put(_historyInterval);
+    out.put(_lastTsRun);
+    out.put<uint8_t>(_lastTsRecorded);
+    out.put(_lastChargePower);
+    out.put(_holdPower);
+    out.put(_trip);
+    out.put(_throughput);
+    out.put(_cycleDamage);
+    _cycles.save_state(out);
+    out.put_vector(_history->socTime);
+    out.put_vector(_history->consumpChargerTime);
+    out.put_vector(_history->consumpRouteTime);
+}
+
+
+bool
+Bus::restore_state(CKPT::Reader& in, std::vector<BusModelPtr> const& models)
+{
+    int32_t modelIdx = -1;
+    in.expect(_identifier);
+    in.get(modelIdx);
+    if ( modelIdx < 0 || modelIdx >= (int)models.size() || !models[modelIdx] )
+        return false;
+    _model = models[modelIdx];
+    in.get(_stateOfCharge);
+    in.get(_historyInterval);
+    in.get(_lastTsRun);
+    uint8_t lastTsRecorded = 0;
+    in.get(lastTsRecorded);
+    _lastTsRecorded = lastTsRecorded != 0;
+    in.get(_lastChargePower);
+    in.get(_holdPower);
+    in.get(_trip);
+    in.get(_throughput);
+    in.get(_cycleDamage);
+    if ( !_cycles.restore_state(in) )
+        return false;
+    _history.reset(new History());
+    History& history = *_history;
+    in.get_vector(history.socTime);
+    in.get_vector(history.consumpChargerTime);
+    in.get_vector(history.consumpRouteTime);
+
+    return in.good() && !history.socTime.empty();
+}
+
+
 double
 Bus::get_stateOfCharge(int ts) const 
 {
-    auto it = _socTime.find(ts);
-    if ( it == _socTime.end() )
-        return _socTime.find(_lastTsRun)->second;
+    int slot = get_historySlot(ts);
+    if ( slot >= (int)_history->socTime.size() )
+        return _history->socTime.back();
     
-    return it->second;
+    return _history->socTime[slot];
 }
 
 
 double
 Bus::get_consumpCharger(int ts) const 
 {
-    auto it = _consumpChargerTime.find(ts);
-    if ( it == _consumpChargerTime.end() )
+    int slot = get_historySlot(ts);
+    if ( slot >= (int)_history->consumpChargerTime.size() )
         return 0.0;
     
-    return it->second;
+    return _history->consumpChargerTime[slot];
 }
 
 
 double
 Bus::get_consumpRoute(int ts) const 
 {
-    auto it = _consumpRouteTime.find(ts);
-    if ( it == _consumpRouteTime.end() )
+    int slot = get_historySlot(ts);
+    if ( slot >= (int)_history->consumpRouteTime.size() )
         return 0.0;
     
-    return it->second;
+    return _history->consumpRouteTime[slot];
 }
 
 
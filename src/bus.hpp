@@ -1,7 +1,11 @@
 #ifndef BUS_H
 #define BUS_H
 #include <map>
-#include "charger.hpp"
+#include <vector>
+#include <memory>
+#include "bus_model.hpp"
+#include "rainflow.hpp"
+#include "checkpoint.hpp"
 
 namespace BUS {
 
@@ -11,10 +15,19 @@ enum class PowerType {
     e_END
 };
 
+/** Progress through a profiled trip, energy is drained a step at a time while the bus drives */
+struct TripProgress {
+    int32_t  tripIdx;    /** Trip in the route energy table, -1 when not on a profiled trip */
+    int32_t  departTime;
+    int32_t  lastTime;   /** Last step drained */
+    uint32_t segment;    /** Cursor into the trip's segments */
+    double   miles;      /** Miles worth of energy drained so far */
+};
+
 class Bus
 {
 public:
-    Bus(int id, double capacity, double consumptionRate, double chargeRate, double distFirstCharge, PlugType plugType);
+    Bus(int id, BusModelPtr model, double distFirstCharge);
     ~Bus();
     
     bool operator <(Bus const &obj) {
@@ -24,35 +37,85 @@ public:
     int init_soc(double stateOfCharge);
 
     int    get_identifier() const {return _identifier;}
-    double get_capacity() const {return _capacity;}
-    double get_consumptionRate() const {return _consumptionRate;}
-    double get_chargeRate() const {return _chargeRate;}
+    BusModelPtr const& get_model() const {return _model;}
+    double get_capacity() const {return _model->capacity;}
+    double get_consumptionRate() const {return _model->consumptionRate;}
+    double get_chargeRate() const {return _model->chargeRate;}
     double get_distFirstCharge() const {return _distFirstCharge;}
     double get_stateOfCharge() const {return _stateOfCharge;}
     double get_stateOfCharge(int ts) const;
     double get_consumpCharger(int ts) const;
     double get_consumpRoute(int ts) const;
-    double get_minSoc() const {return _minSoc;}
-    double get_maxSoc() const {return _maxSoc;}
-    PlugType get_plugType() const {return _plugType;}
+    double get_minSoc() const {return _model->minSoc;}
+    double get_maxSoc() const {return _model->maxSoc;}
+    PlugType get_plugType() const {return _model->plugType;}
+
+    /** Average kW the pack takes over the next step of timestep seconds from its current SoC */
+    double get_maxChargePower(int timestep) const;
+    /** SoC up to which the pack takes its full charge rate, models without a curve charge flat out */
+    double get_fullPowerSoc() const {return _model->chargeCurve ? _model->chargeCurve->get_fullPowerSoc() : 1.0;}
+    double get_chargePower(int ts) const {return (ts == _lastTsRun) ? _lastChargePower : 0.0;}
+
+    /** SoC and charger power at simTime including held power that has not been settled yet */
+    double get_currentSoc(int simTime, int timestep) const;
+    double get_currentPower(int simTime) const {return (_holdPower != 0.0) ? _holdPower : get_chargePower(simTime);}
+
+    /** History is kept in slots of interval seconds, set before the first command */
+    void set_historyInterval(int interval) {_historyInterval = interval;}
 
     int command_power(double power, double timestep, int simTime, PowerType pt, bool force = false);
 
+    /** Keeps charging at power (kW) for every step until settle is called */
+    void hold_power(double power) {_holdPower = power;}
+    void settle(int simTime, int timestep);
+
+    /** Energy moved through the pack in kWh and the share of its life used by rainflow counted cycles */
+    double get_throughput() const {return _throughput;}
+    double get_wearDamage() const;
+    /** $ of pack wear from moving energy kWh now, negative discharges, O(1) */
+    double get_wearCost(double energy) const;
+
+    /** Starts draining a trip from the step departing at departTime */
+    void start_trip(int tripIdx, int departTime, int timestep);
+    TripProgress& get_trip() {return _trip;}
+    TripProgress const& get_trip() const {return _trip;}
+
+    /** Replaces the vehicle behind this identifier, its SoC as a fraction carries over */
+    void swap_unit(BusModelPtr model) {_model = model;}
+
+    /** Only state that changes while running, the model is written as its catalog index */
+    void save_state(CKPT::Writer& out) const;
+    bool restore_state(CKPT::Reader& in, std::vector<BusModelPtr> const& models);
+
 private:
     int    _identifier;
-    double _capacity;
-    double _consumptionRate;
-    double _chargeRate;
+    BusModelPtr _model;
     double _distFirstCharge;
-    double _minSoc;
-    double _maxSoc;
-    PlugType _plugType;
 
     double _stateOfCharge;
-    std::map<int, double> _socTime;
-    std::map<int, double> _consumpChargerTime;
-    std::map<int, double> _consumpRouteTime;
+    int _historyStart;
+    int _historyInterval;
     int _lastTsRun;
+    bool _lastTsRecorded; /** A step wrote the history slot of _lastTsRun, not just the constructor seed */
+    double _lastChargePower;
+    double _holdPower;
+    TripProgress _trip;
+    Rainflow _cycles;
+    double _throughput;
+    double _cycleDamage; /** From closed cycles, open ones are added by get_wearDamage */
+
+    /** Copies of a bus share history until one of them records, see own_history */
+    struct History {
+        std::vector<double> socTime;
+        std::vector<double> consumpChargerTime;
+        std::vector<double> consumpRouteTime;
+    };
+    std::shared_ptr<History> _history;
+
+    History& own_history();
+    void record_history(int simTime, double chargerEnergy, double routeEnergy);
+    void track_wear(double deltaEnergy);
+    int get_historySlot(int ts) const;
 };
 
 }
@@ -1,11 +1,17 @@
 #include "bus_manager.hpp"
 #include "error.hpp"
+#include "cosim_server.hpp"
+#include "profiler_py.hpp"
+#include "event_log_py.hpp"
+#include "checkpoint_py.hpp"
+#include "release_gil.hpp"
 #include <iostream>
 #include <fstream>
 #include <iomanip>
 #include <chrono>
 #include <thread>
 #include <math.h>
+#include <limits>
 
 
 //#define VERBOSE
@@ -21,10 +27,34 @@ namespace BUS {
 
 #define SMART_CHARGE        0x01
 #define ALLOW_DISCHARGE     0x02
+#define EVENT_DRIVEN        0x04
+#define PLUG_QUEUE          0x08
+#define TARIFF_CHARGE       0x10
+#define PLANNED_CHARGE      0x20
+#define GRID_SIGNAL         0x40
 
 BusManager::BusManager()
 :
-    _totalCharge(0.0)
+    _totalCharge(0.0),
+    _timestep(60),
+    _historyInterval(60),
+    _schedule(new Schedule()),
+    _pool(new ThreadPool(1)),
+    _events(new EVLOG::EventCounter()),
+    _failures(new EVLOG::FailureLedger(_events)),
+    _catalog(new BusCatalog()),
+    _routeModel({12.0, 20.0, 15.0, 0.03, 0.02, 0.6, 1.25}),
+    _nextEventTime(0),
+    _lastSimTime(0),
+    _lastPwrConsump(0.0),
+    _queuePlugs(false),
+    _v2gMode(false),
+    _v2gValue(0.15),
+    _energyCost(0.0),
+    _costWeight(0.5),
+    _carbonWeight(0.5),
+    _gridEnergy(0.0),
+    _gridWeighted(0.0)
 {}
 
 
@@ -32,6 +62,28 @@ BusManager::~BusManager()
 {}
 
 
+int
+BusManager::set_timestep(int timestep, int historyInterval)
+{
+    // Schedule is minute based so steps must line up with every minute
+    if ( timestep <= 0 || 60 % timestep != 0 ){
+        PyErr_SetString(PyExc_ValueError, "Timestep must divide 60 seconds");
+        bp::throw_error_already_set();
+    }
+    if ( historyInterval < timestep || historyInterval % timestep != 0 ){
+        PyErr_SetString(PyExc_ValueError, "History interval must be a multiple of the timestep");
+        bp::throw_error_already_set();
+    }
+
+    _timestep        = timestep;
+    _historyInterval = historyInterval;
+    for (auto& bus: _buses)
+        bus.second->set_historyInterval(historyInterval);
+
+    return 0;
+}
+
+
 int
 BusManager::init_chargers(bpn::ndarray const& chargerIds, bpn::ndarray const& chargerNames,
                         bpn::ndarray const& numberPlugs, bpn::ndarray const& plugTypes)
@@ -92,10 +144,12 @@ BusManager::init_buses(bpn::ndarray const& busIdentifiers, bpn::ndarray const& c
         std::string plugName = std::string(bp::extract<char const *>(plugTypes[line]));
         PlugType plugType = plugNameToType[plugName];
 
-        // If bus is new, add it to the map
+        // If bus is new, add it to the map under the shared block of its model
         if ( _buses.find(busIds[line]) == _buses.end() ){
+            BusModel model = {caps[line], consumpRates[line], chrgRates[line], 0.1, 0.9, plugType, 150.0, 3000.0, 1.8, -1, 0, nullptr};
             BusPtr busPtr;
-            Bus *bus = new Bus(busIds[line], caps[line], consumpRates[line], chrgRates[line], distFirstChrg[line], plugType);
+            Bus *bus = new Bus(busIds[line], _catalog->find_or_add(model), distFirstChrg[line]);
+            bus->set_historyInterval(_historyInterval);
             busPtr.reset(bus);
             _buses.insert(std::pair<int, BusPtr>(busIds[line], busPtr));
         }
@@ -123,6 +177,9 @@ BusManager::init_schedule(bpn::ndarray const& routeIdentifiers, bpn::ndarray con
     double* distNextChrg = reinterpret_cast<double*>(distNextChrg_mi.get_data());
     int* chargerIds      = reinterpret_cast<int*>(chargerIdentifiers.get_data());
 
+    // Schedule is shared with forks so build a new one rather than changing it in place
+    std::shared_ptr<Schedule> schedule(new Schedule(*_schedule));
+
     LOGDBG("Parsing Bus Schedule");
     for (int line = 0; line < dataLen; ++line){
         ChargerPtr chrgPtr;
@@ -147,85 +204,293 @@ BusManager::init_schedule(bpn::ndarray const& routeIdentifiers, bpn::ndarray con
         int chrgStrt = chargeStart[line];
         int chrgEnd  = chargeEnd[line];
 
-        // Add bus to _busSchedule for every time it is charging
-        for (int i = chrgStrt; i < chrgEnd; i+=60){
-            _busSchedule[chrgPtr][i].push_back(busPtr);
+        // Add bus to the schedule for every time it is charging
+        int chrgDepart;
+        for (chrgDepart = chrgStrt; chrgDepart < chrgEnd; chrgDepart+=60){
+            schedule->busIds[chargerIds[line]][chrgDepart].push_back(busIds[line]);
         }
+        schedule->events.insert(chrgStrt);
+        schedule->events.insert(chrgDepart);
 
         // Get bus back to 50% SOC
         if ( std::isnan(distNextChrg[line]) )
             distNextChrg[line] = (0.5 - 0.1) * busPtr->get_capacity() / busPtr->get_consumptionRate();
 
-        _nextTripDist[busIds[line]][chrgEnd] = distNextChrg[line];
+        schedule->nextTripDist[busIds[line]][chrgEnd] = distNextChrg[line];
+        schedule->chargeStart[busIds[line]][chrgEnd]  = chrgStrt;
+    }
+
+    // Sorted once here so departures can be found with set_difference every step
+    for (auto& chrgr: schedule->busIds){
+        for (auto& slot: chrgr.second)
+            std::sort(slot.second.begin(), slot.second.end());
     }
+    _schedule = schedule;
+    build_blockPlans();
+
+    init_chargerList();
+}
+
+
+void
+BusManager::init_chargerList()
+{
+    // Per charger entries exist up front so chargers can be stepped in parallel
+    _chargerList.clear();
+    for (auto& chrgr: _chargers){
+        _nextDepart[chrgr.second];
+        _priorities[chrgr.second];
+        _necessities[chrgr.second];
+        _chargerList.push_back(chrgr.second);
+    }
+    _usageLogged.resize(_chargerList.size() * NUM_PLUG_TYPES, 0);
 }
 
 
 int
 BusManager::run(double powerRequest, int mode, time_t simTime)
 {    
+    PROF_SCOPE("BusManager::run");
     bool allowSmartCharge = (mode & SMART_CHARGE);
+    bool eventDriven      = (mode & EVENT_DRIVEN);
+    bool tariffCharge     = (mode & TARIFF_CHARGE);
+    bool plannedCharge    = (mode & PLANNED_CHARGE) && _plans;
+    bool gridCharge       = (mode & GRID_SIGNAL) && _gridSignal;
+    _queuePlugs           = (mode & PLUG_QUEUE);
+    _v2gMode              = (mode & ALLOW_DISCHARGE);
 
     if ( (simTime % 3600) == 0)
         std::cout << "Sim Time: " << simTime/3600 << std::endl;
 
+    // Nothing changes until the next event so repeat the last step
+    if ( eventDriven && simTime == _lastSimTime + _timestep && simTime < _nextEventTime ){
+        PROF_COUNT("run_skippedSteps", 1);
+        _totalCharge += to_stepEnergy(_lastPwrConsump);
+        if ( _tariff )
+            _energyCost += _tariff->get_price(simTime) * to_stepEnergy(_lastPwrConsump);
+        if ( _gridSignal ){
+            _gridEnergy   += to_stepEnergy(_lastPwrConsump);
+            _gridWeighted += _gridSignal->get_index(simTime, _costWeight, _carbonWeight) * to_stepEnergy(_lastPwrConsump);
+        }
+        _lastSimTime = simTime;
+        return _lastPwrConsump;
+    }
+
+    // Bring held buses up to date before making new decisions
+    for (auto& bus: _buses)
+        bus.second->settle(simTime, _timestep);
+    if ( _routeEnergy ){
+        PROF_SCOPE("handle_trips");
+        handle_trips(simTime);
+    }
+
+    int numChargers = _chargerList.size();
     double powerConsumption = 0.0;
-    std::vector<Priority> priorities;
-    std::map<BusPtr, bool> necessities;
+    std::vector<double> chrgrPwr(numChargers, 0.0);
+    std::vector<double> chrgrEnergy(numChargers, 0.0);
+
+    // Get departure times and priorities for all buses at each charging station
+    _pool->parallel_for(numChargers, [&](int idx){
+        ChargerPtr chrgr = _chargerList[idx];
+        {
+            PROF_SCOPE("get_nextDepartureTimes");
+            _nextDepart.at(chrgr) = get_nextDepartureTimes(chrgr, simTime);
+        }
+        PROF_SCOPE("get_priorities");
+        _priorities.at(chrgr).clear();
+        _necessities.at(chrgr).clear();
+        get_priorities(_priorities.at(chrgr), _necessities.at(chrgr), chrgr, simTime);
+    });
+    for (auto& chrgr: _chargerList){
+        for (auto& bus: _priorities.at(chrgr))
+            _busToCharger[bus.first] = chrgr;
+    }
 
-    // Get departure times for all buses at each charging station
-    for (auto& chrgr: _chargers){
-        _nextDepart[chrgr.second] = get_nextDepartureTimes(chrgr.second, simTime);
-        get_priorities(priorities, necessities, chrgr.second, simTime);
-        for (auto& bus: priorities)
-            _busToCharger[bus.first] = chrgr.second;
-        _priorities[chrgr.second] = priorities;
-        _necessities[chrgr.second] = necessities;
-        priorities.clear();
-        necessities.clear();
-    }
-
-    std::map<ChargerPtr, std::map<PlugType, int>> *chrgrsUsed = new std::map<ChargerPtr, std::map<PlugType, int>>;
-    std::shared_ptr<std::map<ChargerPtr, std::map<PlugType, int>>> chrgrsUsedPtr;
-    handle_necessaryCharging(powerConsumption, chrgrsUsed, simTime);
-    if (allowSmartCharge)
-        handle_powerRequest(powerConsumption, chrgrsUsed, powerRequest, simTime);
-    else
-        handle_remainingCharging(powerConsumption, chrgrsUsed, simTime);
-    chrgrsUsedPtr.reset(chrgrsUsed);
-    _chrgrsUsedTime.push_back(chrgrsUsedPtr);
-    handle_routes(simTime);
+    // Plugs are handed out again every step unless buses hold them and queue for them
+    for (auto& chrgr: _chargerList){
+        if ( _queuePlugs )
+            chrgr->advance_plugs(simTime);
+        else
+            chrgr->release_all();
+    }
+
+    // Buses claim power per charger, budgets are then set by charger and feeder caps before dispatch
+    std::vector<std::vector<PowerClaim>> claims(numChargers);
+    std::vector<double> budgets(numChargers);
+    _pool->parallel_for(numChargers, [&](int idx){
+        PROF_SCOPE("handle_necessaryCharging");
+        handle_necessaryCharging(_chargerList[idx], claims[idx], simTime);
+    });
+    get_chargerBudgets(claims, chrgrPwr, budgets);
+    _pool->parallel_for(numChargers, [&](int idx){
+        dispatch_claims(claims[idx], budgets[idx], chrgrPwr[idx], chrgrEnergy[idx], simTime);
+    });
+    if (allowSmartCharge){
+        reduce_chargerTotals(powerConsumption, chrgrPwr, chrgrEnergy);
+        PROF_SCOPE("handle_powerRequest");
+        handle_powerRequest(powerConsumption, chrgrPwr, powerRequest, simTime);
+    }
+    else if (plannedCharge){
+        _pool->parallel_for(numChargers, [&](int idx){
+            PROF_SCOPE("handle_plannedCharging");
+            handle_plannedCharging(_chargerList[idx], claims[idx], simTime);
+        });
+        get_chargerBudgets(claims, chrgrPwr, budgets);
+        _pool->parallel_for(numChargers, [&](int idx){
+            dispatch_claims(claims[idx], budgets[idx], chrgrPwr[idx], chrgrEnergy[idx], simTime);
+        });
+        reduce_chargerTotals(powerConsumption, chrgrPwr, chrgrEnergy);
+    }
+    else if (gridCharge){
+        double gridIndex = _gridSignal->get_index(simTime, _costWeight, _carbonWeight);
+        _pool->parallel_for(numChargers, [&](int idx){
+            PROF_SCOPE("handle_gridCharging");
+            handle_gridCharging(_chargerList[idx], claims[idx], simTime, gridIndex);
+        });
+        get_chargerBudgets(claims, chrgrPwr, budgets);
+        _pool->parallel_for(numChargers, [&](int idx){
+            dispatch_claims(claims[idx], budgets[idx], chrgrPwr[idx], chrgrEnergy[idx], simTime);
+        });
+        reduce_chargerTotals(powerConsumption, chrgrPwr, chrgrEnergy);
+    }
+    else if (tariffCharge){
+        _pool->parallel_for(numChargers, [&](int idx){
+            PROF_SCOPE("handle_tariffCharging");
+            handle_tariffCharging(_chargerList[idx], claims[idx], simTime);
+        });
+        get_chargerBudgets(claims, chrgrPwr, budgets);
+        _pool->parallel_for(numChargers, [&](int idx){
+            // Only necessary charging may raise a site's peak
+            double budget = std::min(budgets[idx], get_demandRoom(_chargerList[idx], chrgrPwr[idx]));
+            dispatch_claims(claims[idx], budget, chrgrPwr[idx], chrgrEnergy[idx], simTime);
+        });
+        reduce_chargerTotals(powerConsumption, chrgrPwr, chrgrEnergy);
+    }
+    else {
+        _pool->parallel_for(numChargers, [&](int idx){
+            PROF_SCOPE("handle_remainingCharging");
+            handle_remainingCharging(_chargerList[idx], claims[idx], simTime);
+        });
+        get_chargerBudgets(claims, chrgrPwr, budgets);
+        _pool->parallel_for(numChargers, [&](int idx){
+            dispatch_claims(claims[idx], budgets[idx], chrgrPwr[idx], chrgrEnergy[idx], simTime);
+        });
+        reduce_chargerTotals(powerConsumption, chrgrPwr, chrgrEnergy);
+    }
+    account_costs(simTime, powerConsumption);
+    if ( _queuePlugs ){
+        _pool->parallel_for(numChargers, [&](int idx){
+            ChargerPtr chrgr = _chargerList[idx];
+            // Buses that may still charge or discharge stay plugged in while idle
+            for (auto& priority: _priorities.at(chrgr)){
+                if ( priority.second > 0.0 || allowSmartCharge )
+                    chrgr->keep_plug(priority.first->get_identifier(), simTime);
+            }
+            chrgr->end_step(simTime, _timestep);
+        });
+    }
+    log_chargerUsage(simTime);
+
+    _pool->parallel_for(numChargers, [&](int idx){
+        PROF_SCOPE("handle_routes");
+        handle_routes(_chargerList[idx], simTime);
+    });
 
     _busToCharger.clear();
 
+    _lastSimTime    = simTime;
+    _lastPwrConsump = powerConsumption;
+    // Planned buses may start charging at any slot and the grid signal moves every step
+    _nextEventTime  = (eventDriven && !plannedCharge && !gridCharge) ? find_nextEventTime(simTime, allowSmartCharge) : simTime + _timestep;
+
     return powerConsumption;
 }
 
 
+int
+BusManager::serve(std::string socketPath, int mode, int maxStepsPerPoll)
+{
+    CosimServer server(*this, mode, maxStepsPerPoll);
+
+    return server.serve(socketPath);
+}
+
+
+int
+BusManager::set_numThreads(int numThreads)
+{
+    _pool.reset(new ThreadPool(numThreads));
+
+    return 0;
+}
+
+
+void
+BusManager::reduce_chargerTotals(double& pwrConsump, std::vector<double> const& chrgrPwr, std::vector<double> const& chrgrEnergy)
+{
+    // Sum in charger order so results do not depend on the number of threads
+    for (size_t idx = 0; idx < chrgrPwr.size(); ++idx){
+        pwrConsump   += chrgrPwr[idx];
+        _totalCharge += chrgrEnergy[idx];
+    }
+}
+
+
+void
+BusManager::log_chargerUsage(time_t simTime)
+{
+    for (size_t idx = 0; idx < _chargerList.size(); ++idx){
+        for (int type = 0; type < NUM_PLUG_TYPES; ++type){
+            uint16_t inUse = _chargerList[idx]->get_numPlugsInUse((PlugType)type);
+            uint16_t& logged = _usageLogged[idx*NUM_PLUG_TYPES + type];
+            if ( inUse == logged )
+                continue;
+
+            UsageDelta delta = {(int32_t)simTime, (uint16_t)idx, (uint8_t)type, inUse};
+            _usageLog.push_back(delta);
+            logged = inUse;
+        }
+    }
+}
+
+
 void
 BusManager::file_dump()
 {
+    PROF_SCOPE("BusManager::file_dump");
     std::ofstream outfile;
 
-    /** Charger Usage */
+    for (auto& bus: _buses)
+        bus.second->settle(_lastSimTime + _timestep, _timestep);
+
+    /** Charger Usage, replayed from the delta log at every history slot */
     outfile.open("output/charger_usage.csv");
     outfile << ",";
-    for (auto& chrgr: *_chrgrsUsedTime[0]){
-        for (auto plugType = chrgr.second.begin(); plugType != chrgr.second.end(); plugType++)
-            outfile << chrgr.first->get_name() << " - " << plugTypeToName[plugType->first] << ",";
+    for (auto& chrgr: _chargerList){
+        for (int type = 0; type < NUM_PLUG_TYPES; ++type){
+            if ( chrgr->has_plugType((PlugType)type) )
+                outfile << chrgr->get_name() << " - " << plugTypeToName[(PlugType)type] << ",";
+        }
     }
     outfile << std::endl;
 
-    int simTime = 16200;
-    for (auto& chrgrMap: _chrgrsUsedTime){
+    int simTime;
+    size_t nextDelta = 0;
+    std::vector<uint16_t> inUse(_chargerList.size() * NUM_PLUG_TYPES, 0);
+    for (simTime = 16200; simTime <= _lastSimTime; simTime += _historyInterval){
+        for ( ; nextDelta < _usageLog.size() && _usageLog[nextDelta].simTime <= simTime; ++nextDelta){
+            UsageDelta const& delta = _usageLog[nextDelta];
+            inUse[delta.chargerIdx*NUM_PLUG_TYPES + delta.plugType] = delta.inUse;
+        }
+
         outfile << simTime << ",";
-        for (auto& chrgr: *chrgrMap){
-            for (auto plugType = chrgr.second.begin(); plugType != chrgr.second.end(); plugType++)
-                outfile << plugType->second << ",";
+        for (size_t idx = 0; idx < _chargerList.size(); ++idx){
+            for (int type = 0; type < NUM_PLUG_TYPES; ++type){
+                if ( _chargerList[idx]->has_plugType((PlugType)type) )
+                    outfile << inUse[idx*NUM_PLUG_TYPES + type] << ",";
+            }
         }
         outfile << std::endl;
-
-        simTime += 60;
     }
     outfile.close();
 
@@ -236,7 +501,7 @@ BusManager::file_dump()
         outfile << bus.second->get_identifier() << ",";
     outfile << std::endl;
 
-    for (simTime = 16200; simTime < 16200 + 3600*24; simTime+=60){
+    for (simTime = 16200; simTime < 16200 + 3600*24; simTime+=_historyInterval){
         outfile << simTime << ",";
         for (auto& bus: _buses)
             outfile << bus.second->get_stateOfCharge(simTime) << ",";
@@ -251,7 +516,7 @@ BusManager::file_dump()
         outfile << bus.second->get_identifier() << ",";
     outfile << std::endl;
 
-    for (simTime = 16200; simTime < 16200 + 3600*24; simTime+=60){
+    for (simTime = 16200; simTime < 16200 + 3600*24; simTime+=_historyInterval){
         outfile << simTime << ",";
         for (auto& bus: _buses)
             outfile << bus.second->get_consumpCharger(simTime) << ",";
@@ -266,7 +531,7 @@ BusManager::file_dump()
         outfile << bus.second->get_identifier() << ",";
     outfile << std::endl;
 
-    for (simTime = 16200; simTime < 16200 + 3600*24; simTime+=60){
+    for (simTime = 16200; simTime < 16200 + 3600*24; simTime+=_historyInterval){
         outfile << simTime << ",";
         for (auto& bus: _buses)
             outfile << bus.second->get_consumpRoute(simTime) << ",";
@@ -276,331 +541,1567 @@ BusManager::file_dump()
 
     LOGDBG("Total Charge: %.2f", _totalCharge);
 
+    PROF::write_trace();
+    EVLOG::flush();
+
     return;
 }
 
 
+bp::dict
+BusManager::get_stats()
+{
+    return PROF::stats_toDict();
+}
+
+
 void
-BusManager::clear_memory()
+BusManager::set_traceFile(std::string path)
 {
-    _chrgrsUsedTime.clear();
-    _energyChargedTime.clear();
+    PROF::set_traceFile(path);
+}
+
+
+bp::dict
+BusManager::get_eventCounts()
+{
+    return EVLOG::counts_toDict(*_events);
 }
 
 
 int
-BusManager::handle_necessaryCharging(double& pwrConsump, std::map<ChargerPtr, std::map<PlugType, int>> *chrgrsUsed, time_t simTime)
+BusManager::set_eventLog(std::string path)
 {
-    int ret;
-    double chrgRate;
-    std::map<PlugType, int> numPlugs, plugsInUse;
-    std::vector<Priority> priorities;
-    std::map<BusPtr, bool> necessities;
-    
-    if (simTime == 62640){
-        while(1){
-            int i = 1;
-            break;
-        }
+    if ( path.empty() ){
+        EVLOG::close_file();
+        return 0;
     }
 
-    for(auto& chrgr: _busSchedule){
-        numPlugs = chrgr.first->get_numPlugs();
-        for ( auto it = numPlugs.begin(); it != numPlugs.end(); it++ )
-            plugsInUse[it->first] = 0;
-        priorities = _priorities[chrgr.first];
-        necessities = _necessities[chrgr.first];
+    return EVLOG::open_file(path);
+}
 
-        // Priorities vector is in order so we charge the most necessary bus first
-        for (auto& priority : priorities){
-            BusPtr bus = priority.first;
-            PlugType plugType = bus->get_plugType();
 
-            if ( necessities[bus] == true && plugsInUse[plugType] < numPlugs[plugType] ){
-                plugsInUse[plugType]++;
-                chrgRate = bus->get_chargeRate(); // kWh / min
-                chrgRate *= 60; // kW
-                ret = bus->command_power(chrgRate, 60, simTime, PowerType::e_ATCHARGER);
-                if ( ret != 0 ){
-                    if ( ret == OVER_MAX_SOC ){
-                        LOGDBG("%i:\tBus %s : Command would place bus over max SOC", simTime, bus->get_identifier().c_str());
-                        double busSoc = bus->get_stateOfCharge();
-                        double busCap = bus->get_capacity();
-                        double busMaxSoc = bus->get_maxSoc();
-                        double energyToCharge = (busMaxSoc - busSoc) * busCap; // kWh
-                        bus->command_power(energyToCharge*60, 60, simTime, PowerType::e_ATCHARGER);
-                        _totalCharge += energyToCharge;
-                        pwrConsump += energyToCharge*60;
-                    }
-                    else if ( ret == UNDER_MIN_SOC ){
-                        LOGDBG("Bus %i is below min SoC and charging", bus->get_identifier());
-                        bus->command_power(chrgRate, 60, simTime, PowerType::e_ATCHARGER, true);
-                        _totalCharge += chrgRate / 60;
-                        pwrConsump += chrgRate;
-                    }
-                } else {
-                    _totalCharge += chrgRate / 60;
-                    pwrConsump += chrgRate;
-                }
-            }
-        }
-        (*chrgrsUsed)[chrgr.first] = plugsInUse;
-        plugsInUse.clear();
+bp::dict
+BusManager::get_failureCounts()
+{
+    return EVLOG::failures_toDict(*_failures);
+}
+
+
+bp::list
+BusManager::get_failureRecords()
+{
+    return EVLOG::failures_toList(*_failures);
+}
+
+
+std::string
+BusManager::save_state() const
+{
+    CKPT::Writer out("EBBUSCK1");
+    out.put(_totalCharge);
+    out.put(_timestep);
+    out.put(_historyInterval);
+    out.put(_nextEventTime);
+    out.put(_lastSimTime);
+    out.put(_lastPwrConsump);
+    out.put(_energyCost);
+    out.put(_gridEnergy);
+    out.put(_gridWeighted);
+
+    // Buses refer to their model by position in this table
+    out.put<uint32_t>(_catalog->get_numModels());
+    for (size_t idx = 0; idx < _catalog->get_numModels(); ++idx){
+        BusModelPtr model = _catalog->get_model(idx);
+        out.put(model->capacity);
+        out.put(model->consumptionRate);
+        out.put(model->chargeRate);
+        out.put(model->minSoc);
+        out.put(model->maxSoc);
+        out.put<int32_t>((int)model->plugType);
+        out.put(model->packCost);
+        out.put(model->cycleLife);
+        out.put(model->wearExponent);
+        out.put<int32_t>(model->curveIdx);
     }
 
-    return 0;
+    out.put<uint32_t>(_buses.size());
+    for (auto& bus: _buses)
+        bus.second->save_state(out);
+
+    // Plug counts may have been changed by set_chargerPlugs so they are written with the plug state
+    out.put<uint32_t>(_chargerList.size());
+    for (auto& chrgr: _chargerList)
+        chrgr->save_state(out);
+    out.put<uint32_t>(_feederCaps.size());
+    for (auto& feeder: _feederCaps){
+        out.put<int32_t>(feeder.first);
+        out.put(feeder.second);
+    }
+    out.put<uint32_t>(_usageLog.size());
+    for (auto& delta: _usageLog){
+        out.put(delta.simTime);
+        out.put(delta.chargerIdx);
+        out.put(delta.plugType);
+        out.put(delta.inUse);
+    }
+
+    _failures->save_state(out);
+
+    return out.get_blob();
 }
 
 
 int
-BusManager::handle_remainingCharging(double& pwrConsump, std::map<ChargerPtr, std::map<PlugType, int>> *chrgrsUsed, time_t simTime)
+BusManager::restore_state(std::string const& blob)
 {
-    int ret;
-    double chrgRate;
-    std::map<PlugType, int> numPlugs, plugsInUse;
-    std::vector<Priority> priorities;
-    std::map<BusPtr, bool> necessities;
-
-    for(auto& chrgr: _busSchedule){
-        numPlugs = chrgr.first->get_numPlugs();
-        for ( auto it = numPlugs.begin(); it != numPlugs.end(); it++ )
-            plugsInUse[it->first] = (*chrgrsUsed)[chrgr.first][it->first];
-        priorities = _priorities[chrgr.first];
-        necessities = _necessities[chrgr.first];
+    CKPT::Reader in(blob.data(), blob.size(), "EBBUSCK1");
+    double totalCharge = 0.0;
+    int timestep = 0, historyInterval = 0, nextEventTime = 0, lastSimTime = 0;
+    double lastPwrConsump = 0.0;
+    in.get(totalCharge);
+    in.get(timestep);
+    in.get(historyInterval);
+    in.get(nextEventTime);
+    in.get(lastSimTime);
+    in.get(lastPwrConsump);
+    double energyCost = 0.0, gridEnergy = 0.0, gridWeighted = 0.0;
+    in.get(energyCost);
+    in.get(gridEnergy);
+    in.get(gridWeighted);
+
+    // Models are matched against the catalog once the whole blob checks out, until then buses
+    // point at these stand-ins. Curves are not checkpointed so they must already be loaded.
+    std::vector<BusModelPtr> models;
+    uint32_t numModels = 0;
+    in.get(numModels);
+    for (uint32_t idx = 0; idx < numModels && in.good(); ++idx){
+        BusModel model = {0.0, 0.0, 0.0, 0.0, 0.0, PlugType::SAEJ3105, 0.0, 0.0, 0.0, -1, 0, nullptr};
+        int32_t plugType = 0, curveIdx = -1;
+        in.get(model.capacity);
+        in.get(model.consumptionRate);
+        in.get(model.chargeRate);
+        in.get(model.minSoc);
+        in.get(model.maxSoc);
+        in.get(plugType);
+        in.get(model.packCost);
+        in.get(model.cycleLife);
+        in.get(model.wearExponent);
+        in.get(curveIdx);
+        if ( plugType < 0 || plugType >= NUM_PLUG_TYPES || curveIdx >= (int)_catalog->get_numCurves() )
+            return -1;
+        model.plugType = (PlugType)plugType;
+        model.curveIdx = curveIdx;
+        models.push_back(BusModelPtr(new BusModel(model)));
+    }
 
-        // Priorities vector is in order so we charge the most necessary bus first
-        for (auto& priority : priorities){
-            BusPtr bus = priority.first;
-            PlugType plugType = bus->get_plugType();
-            double chargePriority = priority.second;
+    // Read into copies so a bad blob leaves this manager as it was
+    std::vector<Bus> buses;
+    in.expect<uint32_t>(_buses.size());
+    for (auto& bus: _buses){
+        buses.push_back(*bus.second);
+        if ( !in.good() || !buses.back().restore_state(in, models) )
+            return -1;
+        // Trip tables are not checkpointed either, the same one must be loaded
+        if ( buses.back().get_trip().tripIdx >= (_routeEnergy ? _routeEnergy->get_numTrips() : 0) )
+            return -1;
+    }
 
-            if ( necessities[bus] == false && chargePriority > 0.0 && plugsInUse[plugType] < numPlugs[plugType] ){
-                plugsInUse[plugType]++;
-                chrgRate = bus->get_chargeRate(); // kWh / min
-                chrgRate *= 60; // kW
-                ret = bus->command_power(chrgRate, 60, simTime, PowerType::e_ATCHARGER);
-                if ( ret != 0 ){
-                    if ( ret == OVER_MAX_SOC ){
-                        LOGDBG("%i:\tBus %s : Command would place bus over max SOC", simTime, bus->get_identifier().c_str());
-                        double busSoc = bus->get_stateOfCharge();
-                        double busCap = bus->get_capacity();
-                        double busMaxSoc = bus->get_maxSoc();
-                        double energyToCharge = (busMaxSoc - busSoc) * busCap; // kWh
-                        bus->command_power(energyToCharge*60, 60, simTime, PowerType::e_ATCHARGER);
-                        _totalCharge += energyToCharge;
-                        pwrConsump += energyToCharge*60;
-                    }
-                    else if ( ret == UNDER_MIN_SOC ){
-                        LOGDBG("Bus %i is below min SoC and charging", bus->get_identifier());
-                        bus->command_power(chrgRate, 60, simTime, PowerType::e_ATCHARGER, true);
-                        _totalCharge += chrgRate / 60;
-                        pwrConsump += chrgRate;
-                    }
-                } else {
-                    _totalCharge += chrgRate / 60;
-                    pwrConsump += chrgRate;
-                }
-            }
-        }
-        (*chrgrsUsed)[chrgr.first] = plugsInUse;
-        plugsInUse.clear();
+    std::vector<Charger> chargers;
+    in.expect<uint32_t>(_chargerList.size());
+    for (auto& chrgr: _chargerList){
+        chargers.push_back(*chrgr);
+        if ( !chargers.back().restore_state(in) )
+            return -1;
+    }
+    std::map<int, double> feederCaps;
+    uint32_t numFeeders = 0;
+    in.get(numFeeders);
+    for (uint32_t idx = 0; idx < numFeeders && in.good(); ++idx){
+        int32_t feederId = 0;
+        double maxPower = 0.0;
+        in.get(feederId);
+        in.get(maxPower);
+        feederCaps[feederId] = maxPower;
     }
+    std::vector<UsageDelta> usageLog;
+    uint32_t numDeltas = 0;
+    in.get(numDeltas);
+    for (uint32_t idx = 0; idx < numDeltas && in.good(); ++idx){
+        UsageDelta delta;
+        in.get(delta.simTime);
+        in.get(delta.chargerIdx);
+        in.get(delta.plugType);
+        in.get(delta.inUse);
+        if ( delta.chargerIdx >= _chargerList.size() || delta.plugType >= NUM_PLUG_TYPES )
+            return -1;
+        usageLog.push_back(delta);
+    }
+
+    if ( !in.good() || !_failures->restore_state(in) )
+        return -1;
+
+    std::map<BusModel const*, BusModelPtr> catalogModels;
+    for (auto& model: models)
+        catalogModels[model.get()] = _catalog->find_or_add(*model);
+    for (auto& bus: buses)
+        bus.swap_unit(catalogModels.at(bus.get_model().get()));
+
+    _totalCharge     = totalCharge;
+    _timestep        = timestep;
+    _historyInterval = historyInterval;
+    _nextEventTime   = nextEventTime;
+    _lastSimTime     = lastSimTime;
+    _lastPwrConsump  = lastPwrConsump;
+    _energyCost      = energyCost;
+    _gridEnergy      = gridEnergy;
+    _gridWeighted    = gridWeighted;
+    size_t idx = 0;
+    for (auto& bus: _buses)
+        *bus.second = buses[idx++];
+    for (idx = 0; idx < _chargerList.size(); ++idx)
+        *_chargerList[idx] = chargers[idx];
+    _feederCaps.swap(feederCaps);
+    // Restored buses may be on other models than before
+    build_blockPlans();
+
+    // Deltas are replayed so the next step only logs what changed since the checkpoint
+    _usageLog.swap(usageLog);
+    std::fill(_usageLogged.begin(), _usageLogged.end(), 0);
+    for (auto& delta: _usageLog)
+        _usageLogged[delta.chargerIdx*NUM_PLUG_TYPES + delta.plugType] = delta.inUse;
 
     return 0;
 }
 
 
+BusManager
+BusManager::fork() const
+{
+    BusManager branch;
+    branch._totalCharge     = _totalCharge;
+    branch._timestep        = _timestep;
+    branch._historyInterval = _historyInterval;
+    branch._nextEventTime   = _nextEventTime;
+    branch._lastSimTime     = _lastSimTime;
+    branch._lastPwrConsump  = _lastPwrConsump;
+
+    // The schedule never changes while running so it is shared, chargers hold live plug state
+    branch._schedule = _schedule;
+    branch._pool.reset(new ThreadPool(_pool->get_numThreads()));
+    for (auto& chrgr: _chargers)
+        branch._chargers[chrgr.first].reset(new Charger(*chrgr.second));
+    if ( !_chargerList.empty() )
+        branch.init_chargerList();
+
+    // Bus copies are a handful of scalars and a model pointer, their history stays shared until written
+    branch._catalog = _catalog;
+    for (auto& bus: _buses)
+        branch._buses[bus.first].reset(new Bus(*bus.second));
+
+    branch._queuePlugs  = _queuePlugs;
+    branch._v2gMode     = _v2gMode;
+    branch._v2gValue    = _v2gValue;
+    branch._tariff      = _tariff;
+    branch._plans       = _plans;
+    branch._energyCost  = _energyCost;
+    branch._gridSignal  = _gridSignal;
+    branch._costWeight  = _costWeight;
+    branch._carbonWeight = _carbonWeight;
+    branch._gridEnergy  = _gridEnergy;
+    branch._gridWeighted = _gridWeighted;
+    branch._feederCaps  = _feederCaps;
+    branch._routeModel  = _routeModel;
+    branch._routeEnergy = _routeEnergy;
+    branch._blockPlans  = _blockPlans;
+    branch._usageLog    = _usageLog;
+    branch._usageLogged = _usageLogged;
+
+    CKPT::Writer ledger("EBLEDGER");
+    _failures->save_state(ledger);
+    CKPT::Reader ledgerIn(ledger.get_blob().data(), ledger.get_blob().size(), "EBLEDGER");
+    branch._failures->restore_state(ledgerIn);
+    branch._events->assign(*_events);
+
+    return branch;
+}
+
+
 int
-BusManager::handle_powerRequest(double& pwrConsump, std::map<ChargerPtr, std::map<PlugType, int>> *chrgrsUsed, double powerRequest, time_t simTime)
+BusManager::set_chargerPlugs(int chargerId, int plugType, int numPlugs)
 {
-    int ret;
-    double chrgRate, targetPwr;
-    std::map<PlugType, int> numPlugs, plugsInUse;
-    std::vector<Priority> priorities;
-    std::map<BusPtr, bool> necessities;
+    auto it = _chargers.find(chargerId);
+    if ( it == _chargers.end() || numPlugs < 0 || plugType < 0 || plugType >= NUM_PLUG_TYPES ){
+        PyErr_SetString(PyExc_ValueError, "Charger or plug type does not exist or plug count is negative");
+        bp::throw_error_already_set();
+    }
 
-    // Calculate Target to hit
-    targetPwr = powerRequest - pwrConsump;
+    // Each branch owns its chargers so this does not reach the parent
+    it->second->set_numPlugs(numPlugs, static_cast<PlugType>(plugType));
 
-    // Order all available buses by priority
-    for(auto& chrgr: _busSchedule){
-        auto appendPriorities = _priorities[chrgr.first];
-        priorities.insert(priorities.end(), appendPriorities.begin(), appendPriorities.end());
+    return 0;
+}
 
-        auto appendNecessities = _necessities[chrgr.first];
-        necessities.insert(appendNecessities.begin(), appendNecessities.end());
-    }
-    std::sort(priorities.begin(), priorities.end(), compare_priority);
 
-    while ( std::fabs(targetPwr) >= 1e-5 && priorities.size() != 0 ){
-        if ( targetPwr > 0.0 ){
-            auto bus   = priorities.front().first;
-            auto chargePriority = priorities.front().second;
-            PlugType plugType = bus->get_plugType();
-            auto chrgr = _busToCharger[bus];
-            numPlugs   = chrgr->get_numPlugs();
-            plugsInUse = (*chrgrsUsed)[chrgr];
+int
+BusManager::set_plugOverheads(int connectTime, int disconnectTime)
+{
+    if ( connectTime < 0 || disconnectTime < 0 ){
+        PyErr_SetString(PyExc_ValueError, "Plug overheads must not be negative");
+        bp::throw_error_already_set();
+    }
 
-            if ( necessities[bus] == false && plugsInUse[plugType] < numPlugs[plugType] ){
-                (*chrgrsUsed)[chrgr][plugType]++;
-                chrgRate = std::min(bus->get_chargeRate()*60, targetPwr);
-                ret = bus->command_power(chrgRate, 60, simTime, PowerType::e_ATCHARGER);
-                if ( ret != 0 ){
-                    if ( ret == OVER_MAX_SOC ){
-                        LOGDBG("%i:\tBus %s : Command would place bus over max SOC", simTime, bus->get_identifier().c_str());
-                        double busSoc = bus->get_stateOfCharge();
-                        double busCap = bus->get_capacity();
-                        double busMaxSoc = bus->get_maxSoc();
-                        double energyToCharge = (busMaxSoc - busSoc) * busCap; // kWh
-                        bus->command_power(energyToCharge*60, 60, simTime, PowerType::e_ATCHARGER);
-                        _totalCharge += energyToCharge;
-                        pwrConsump += energyToCharge*60;
-                        targetPwr -= energyToCharge*60;
-                    }
-                    else if ( ret == UNDER_MIN_SOC ){
-                        LOGDBG("Bus %i is below min SoC and charging", bus->get_identifier());
-                        bus->command_power(chrgRate, 60, simTime, PowerType::e_ATCHARGER, true);
-                        _totalCharge += chrgRate / 60;
-                        pwrConsump += chrgRate;
-                        targetPwr -= chrgRate;
-                    }
-                } else {
-                    _totalCharge += chrgRate / 60;
-                    pwrConsump += chrgRate;
-                    targetPwr -= chrgRate;
-                }
-            }
+    for (auto& chrgr: _chargers)
+        chrgr.second->set_plugOverheads(connectTime, disconnectTime);
 
-            priorities.erase(priorities.begin());
-        } 
-        else if ( targetPwr < 0.0 ){
-            auto bus   = priorities.back().first;
-            auto chargePriority = priorities.back().second;
-            PlugType plugType = bus->get_plugType();
-            auto chrgr = _busToCharger[bus];
-            numPlugs   = chrgr->get_numPlugs();
-            plugsInUse = (*chrgrsUsed)[chrgr];
-
-            if ( necessities[bus] == false && chargePriority < 0.0 && plugsInUse[plugType] < numPlugs[plugType] ){
-                (*chrgrsUsed)[chrgr][plugType]++;
-                chrgRate = std::max(-bus->get_chargeRate()*60, targetPwr);
-                chrgRate = std::max(chrgRate, chargePriority*bus->get_chargeRate());
-                
-                ret = bus->command_power(chrgRate, 60, simTime, PowerType::e_ATCHARGER);
-                if ( ret != 0 ){
-                    if ( ret == OVER_MAX_SOC ){
-                        LOGDBG("Bus %i is above max SoC and discharging", bus->get_identifier());
-                        bus->command_power(chrgRate, 60, simTime, PowerType::e_ATCHARGER, true);
-                        _totalCharge += chrgRate / 60;
-                        pwrConsump += chrgRate;
-                        targetPwr -= chrgRate;
-                    }
-                    else if ( ret == UNDER_MIN_SOC ){
-                        double busSoc = bus->get_stateOfCharge();
-                        double busCap = bus->get_capacity();
-                        double busMinSoc = bus->get_minSoc();
-                        double energyToDschrg = (busSoc - busMinSoc) * busCap; // kWh
-                        bus->command_power(energyToDschrg*60, 60, simTime, PowerType::e_ATCHARGER);
-                        _totalCharge += energyToDschrg;
-                        pwrConsump += energyToDschrg*60;
-                        targetPwr -= energyToDschrg*60;
-                    }
-                } else {
-                    _totalCharge += chrgRate / 60;
-                    pwrConsump += chrgRate;
-                    targetPwr -= chrgRate;
-                }
-            }
+    return 0;
+}
 
-            priorities.erase(--priorities.end());
-        }
 
-        plugsInUse.clear();
+int
+BusManager::set_maxPlugPower(int plugType, double maxPower)
+{
+    if ( plugType < 0 || plugType >= NUM_PLUG_TYPES || maxPower < 0.0 ){
+        PyErr_SetString(PyExc_ValueError, "Plug type does not exist or power is negative");
+        bp::throw_error_already_set();
     }
 
+    for (auto& chrgr: _chargers)
+        chrgr.second->set_maxPlugPower(maxPower, static_cast<PlugType>(plugType));
+
     return 0;
 }
 
 
-void
-BusManager::handle_routes(time_t simTime)
-{   
-    bool firstRun = (simTime == 16200);
-    if ( firstRun )
-        return; // No departures for the first timestep
+bp::dict
+BusManager::get_plugStats()
+{
+    bp::dict stats;
+    for (auto& chrgr: _chargers){
+        bp::dict chrgrStats;
+        chrgrStats["connects"]    = chrgr.second->get_numConnects();
+        chrgrStats["wait_time"]   = chrgr.second->get_waitTime();
+        chrgrStats["max_waiting"] = chrgr.second->get_maxWaiting();
+        chrgrStats["waiting"]     = chrgr.second->get_numWaiting();
+        stats[chrgr.first] = chrgrStats;
+    }
 
-    int busId;
-    double busEff, busTripDist, reqdEnrgForTrip;
+    return stats;
+}
 
-    for(auto& chrgr: _busSchedule){
-        std::vector<BusPtr> first = chrgr.second[simTime-60];
-        std::vector<BusPtr> second = chrgr.second[simTime];
-        std::vector<BusPtr> departures(first.size());
 
-        // Pretty weird to sort by pointer address but it works
-        std::sort(first.begin(), first.end());
-        std::sort(second.begin(), second.end());
+int
+BusManager::set_chargerCap(int chargerId, double maxPower)
+{
+    auto it = _chargers.find(chargerId);
+    if ( it == _chargers.end() || maxPower < 0.0 ){
+        PyErr_SetString(PyExc_ValueError, "Charger does not exist or power is negative");
+        bp::throw_error_already_set();
+    }
 
-        auto it = std::set_difference(first.begin(), first.end(), second.begin(), second.end(), departures.begin());
-        departures.resize(it-departures.begin());
+    it->second->set_powerCap(maxPower);
+
+    return 0;
+}
 
-        for (auto& bus: departures){
-            busId = bus->get_identifier();
-            // Get bus kWh,mi
-            busEff = bus->get_consumptionRate();
-            // Get bus next travel distance
-            busTripDist = _nextTripDist[busId][simTime];
-            // Calc necessary kWh to make next trip
-            reqdEnrgForTrip = busTripDist * busEff;
 
-            int ret = bus->command_power(-reqdEnrgForTrip, 3600, simTime, PowerType::e_ONROUTE);
-            if ( ret != 0 )
-                std::cout << simTime << ":\tBus " << busId << ": Not enough energy for route" << std::endl;
+int
+BusManager::set_feederCap(int feederId, double maxPower, bpn::ndarray const& chargerIds)
+{
+    if ( maxPower < 0.0 ){
+        PyErr_SetString(PyExc_ValueError, "Feeder power is negative");
+        bp::throw_error_already_set();
+    }
+
+    int numChargers = chargerIds.shape(0);
+    int* chrgIds = reinterpret_cast<int*>(chargerIds.get_data());
+    for (int idx = 0; idx < numChargers; ++idx){
+        if ( _chargers.find(chrgIds[idx]) == _chargers.end() ){
+            PyErr_SetString(PyExc_ValueError, "Charger does not exist");
+            bp::throw_error_already_set();
         }
     }
-}
 
+    for (int idx = 0; idx < numChargers; ++idx)
+        _chargers[chrgIds[idx]]->set_feeder(feederId);
+    _feederCaps[feederId] = maxPower;
 
-// Compares two priorities. 
-bool 
-BusManager::compare_priority(Priority lhs, Priority rhs){
-    return (lhs.second > rhs.second);
+    return 0;
 }
 
 
 int
-BusManager::get_priorities(std::vector<Priority> &priorities, std::map<BusPtr, bool> &necessities, 
-                            ChargerPtr charger, time_t simTime)
+BusManager::set_chargeCurve(bpn::ndarray const& busIds, bpn::ndarray const& socPoints, bpn::ndarray const& powerFactors)
 {
-    int busId;
-    double busSoc, busCap, busEff, busTripDist;
-    double reqdEnrgForTrip, reqdEnrgBeforeTrip, reqdChrgRate, normPriority;
-    std::map<BusPtr, int> nextDepart;
+    int numPoints = socPoints.shape(0);
+    if ( numPoints < 2 || numPoints != powerFactors.shape(0) ){
+        PyErr_SetString(PyExc_ValueError, "Charge curve needs at least two SoC and power points of equal length");
+        bp::throw_error_already_set();
+    }
 
-    // Get departure times for all buses at this charger
-    nextDepart = _nextDepart[charger];
+    double* socs    = reinterpret_cast<double*>(socPoints.get_data());
+    double* factors = reinterpret_cast<double*>(powerFactors.get_data());
+    for (int idx = 0; idx < numPoints; ++idx){
+        if ( socs[idx] < 0.0 || socs[idx] > 1.0 || (idx > 0 && socs[idx] <= socs[idx-1]) ){
+            PyErr_SetString(PyExc_ValueError, "Charge curve SoC points must increase within [0, 1]");
+            bp::throw_error_already_set();
+        }
+    }
+
+    int numBuses = busIds.shape(0);
+    int* ids = reinterpret_cast<int*>(busIds.get_data());
+    for (int idx = 0; idx < numBuses; ++idx){
+        if ( _buses.find(ids[idx]) == _buses.end() ){
+            PyErr_SetString(PyExc_ValueError, "Bus does not exist");
+            bp::throw_error_already_set();
+        }
+    }
+
+    // One table shared by every model the given buses end up on
+    std::shared_ptr<ChargeCurve const> curve(new ChargeCurve(std::vector<double>(socs, socs + numPoints),
+                                                             std::vector<double>(factors, factors + numPoints)));
+    int curveIdx = _catalog->add_curve(curve);
+    for (int idx = 0; idx < numBuses; ++idx){
+        BusPtr const& bus = _buses[ids[idx]];
+        BusModel model = *bus->get_model();
+        model.curveIdx = curveIdx;
+        bus->swap_unit(_catalog->find_or_add(model));
+    }
+
+    return 0;
+}
+
+
+int
+BusManager::set_routeModel(double cruiseSpeed, double dwellTime, double stopDelay, double stopMiles,
+                           double climbMiles, double regenFraction, double circuity)
+{
+    if ( cruiseSpeed <= 0.0 || dwellTime < 0.0 || stopDelay < 0.0 || stopMiles < 0.0 || climbMiles < 0.0 ||
+         regenFraction < 0.0 || regenFraction > 1.0 || circuity < 1.0 ){
+        PyErr_SetString(PyExc_ValueError, "Route model needs a positive speed, non-negative overheads, regen within [0, 1] and circuity of at least 1");
+        bp::throw_error_already_set();
+    }
+
+    _routeModel = {cruiseSpeed, dwellTime, stopDelay, stopMiles, climbMiles, regenFraction, circuity};
+
+    return 0;
+}
+
+
+int
+BusManager::init_routeEnergy(bpn::ndarray const& stopLats, bpn::ndarray const& stopLons, bpn::ndarray const& stopElevs,
+                             bpn::ndarray const& tripOffsets, bpn::ndarray const& tripStops)
+{
+    int numStops = stopLats.shape(0);
+    if ( numStops != stopLons.shape(0) || numStops != stopElevs.shape(0) || tripOffsets.shape(0) < 1 ){
+        PyErr_SetString(PyExc_TypeError, "Stop data lengths inconsistent or no trip offsets");
+        bp::throw_error_already_set();
+    }
+
+    int numOffsets = tripOffsets.shape(0);
+    int numVisits  = tripStops.shape(0);
+    int* offsets = reinterpret_cast<int*>(tripOffsets.get_data());
+    int* stops   = reinterpret_cast<int*>(tripStops.get_data());
+    for (int idx = 0; idx < numOffsets; ++idx){
+        if ( offsets[idx] < 0 || offsets[idx] > numVisits || (idx > 0 && offsets[idx] < offsets[idx-1]) ){
+            PyErr_SetString(PyExc_ValueError, "Trip offsets must increase within the stop list");
+            bp::throw_error_already_set();
+        }
+    }
+    for (int idx = 0; idx < numVisits; ++idx){
+        if ( stops[idx] < 0 || stops[idx] >= numStops ){
+            PyErr_SetString(PyExc_ValueError, "Trip stop does not exist");
+            bp::throw_error_already_set();
+        }
+    }
+
+    double* lats  = reinterpret_cast<double*>(stopLats.get_data());
+    double* lons  = reinterpret_cast<double*>(stopLons.get_data());
+    double* elevs = reinterpret_cast<double*>(stopElevs.get_data());
+    _routeEnergy.reset(new RouteEnergy(_routeModel, std::vector<double>(lats, lats + numStops),
+                                       std::vector<double>(lons, lons + numStops), std::vector<double>(elevs, elevs + numStops),
+                                       std::vector<int>(offsets, offsets + numOffsets), std::vector<int>(stops, stops + numVisits)));
+
+    // Assignments index the old table
+    std::shared_ptr<Schedule> schedule(new Schedule(*_schedule));
+    schedule->nextTrip.clear();
+    _schedule = schedule;
+    for (auto& bus: _buses)
+        bus.second->get_trip().tripIdx = -1;
+    build_blockPlans();
+
+    return 0;
+}
+
+
+int
+BusManager::assign_trips(bpn::ndarray const& busIds, bpn::ndarray const& departTimes, bpn::ndarray const& tripIdxs)
+{
+    int dataLen = busIds.shape(0);
+    if ( dataLen != departTimes.shape(0) || dataLen != tripIdxs.shape(0) ){
+        PyErr_SetString(PyExc_TypeError, "Trip assignment lengths inconsistent");
+        bp::throw_error_already_set();
+    }
+
+    int* ids     = reinterpret_cast<int*>(busIds.get_data());
+    int* departs = reinterpret_cast<int*>(departTimes.get_data());
+    int* trips   = reinterpret_cast<int*>(tripIdxs.get_data());
+    int numTrips = _routeEnergy ? _routeEnergy->get_numTrips() : 0;
+    for (int idx = 0; idx < dataLen; ++idx){
+        if ( _buses.find(ids[idx]) == _buses.end() || trips[idx] < 0 || trips[idx] >= numTrips ){
+            PyErr_SetString(PyExc_ValueError, "Bus or trip does not exist, trips need init_routeEnergy first");
+            bp::throw_error_already_set();
+        }
+        // A trip without segments would be driven at no energy
+        if ( _routeEnergy->get_numSegments(trips[idx]) == 0 ){
+            PyErr_SetString(PyExc_ValueError, "Trip has fewer than two stops");
+            bp::throw_error_already_set();
+        }
+    }
+
+    // The schedule may be shared with branches so assignments go into a copy
+    std::shared_ptr<Schedule> schedule(new Schedule(*_schedule));
+    for (int idx = 0; idx < dataLen; ++idx)
+        schedule->nextTrip[ids[idx]][departs[idx]] = trips[idx];
+    _schedule = schedule;
+    build_blockPlans();
+
+    return 0;
+}
+
+
+int
+BusManager::set_degradation(bpn::ndarray const& busIds, double packCost, double cycleLife, double wearExponent)
+{
+    if ( packCost < 0.0 || cycleLife <= 0.0 || wearExponent < 1.0 ){
+        PyErr_SetString(PyExc_ValueError, "Pack cost must be non-negative, cycle life positive and the wear exponent at least 1");
+        bp::throw_error_already_set();
+    }
+
+    int numBuses = busIds.shape(0);
+    int* ids = reinterpret_cast<int*>(busIds.get_data());
+    for (int idx = 0; idx < numBuses; ++idx){
+        if ( _buses.find(ids[idx]) == _buses.end() ){
+            PyErr_SetString(PyExc_ValueError, "Bus does not exist");
+            bp::throw_error_already_set();
+        }
+    }
+
+    for (int idx = 0; idx < numBuses; ++idx){
+        BusPtr const& bus = _buses[ids[idx]];
+        BusModel model = *bus->get_model();
+        model.packCost     = packCost;
+        model.cycleLife    = cycleLife;
+        model.wearExponent = wearExponent;
+        bus->swap_unit(_catalog->find_or_add(model));
+    }
+
+    return 0;
+}
+
+
+int
+BusManager::set_v2gValue(double value)
+{
+    if ( value < 0.0 ){
+        PyErr_SetString(PyExc_ValueError, "Discharge value is negative");
+        bp::throw_error_already_set();
+    }
+    _v2gValue = value;
+
+    return 0;
+}
+
+
+bp::dict
+BusManager::get_degradationStats()
+{
+    bp::dict stats;
+    for (auto& bus: _buses){
+        BusModelPtr const& model = bus.second->get_model();
+        double damage = bus.second->get_wearDamage();
+        bp::dict busStats;
+        busStats["throughput"] = bus.second->get_throughput();
+        busStats["damage"]     = damage;
+        busStats["cost"]       = damage * model->packCost * model->capacity;
+        stats[bus.first] = busStats;
+    }
+
+    return stats;
+}
+
+
+int
+BusManager::set_tariff(bpn::ndarray const& periodStarts, bpn::ndarray const& prices)
+{
+    int numPeriods = periodStarts.shape(0);
+    if ( numPeriods < 1 || numPeriods != prices.shape(0) ){
+        PyErr_SetString(PyExc_ValueError, "Tariff needs at least one period and a price for each");
+        bp::throw_error_already_set();
+    }
+
+    int* starts = reinterpret_cast<int*>(periodStarts.get_data());
+    double* price = reinterpret_cast<double*>(prices.get_data());
+    for (int idx = 0; idx < numPeriods; ++idx){
+        if ( (idx == 0 && starts[idx] != 0) || (idx > 0 && starts[idx] <= starts[idx-1]) || starts[idx] >= SECONDS_PER_DAY ){
+            PyErr_SetString(PyExc_ValueError, "Tariff periods must start at 0 and increase within the day");
+            bp::throw_error_already_set();
+        }
+    }
+
+    _tariff.reset(new Tariff(std::vector<int>(starts, starts + numPeriods), std::vector<double>(price, price + numPeriods)));
+
+    return 0;
+}
+
+
+int
+BusManager::set_demandCharge(int chargerId, double threshold, double charge)
+{
+    auto it = _chargers.find(chargerId);
+    if ( it == _chargers.end() || threshold < 0.0 || charge < 0.0 ){
+        PyErr_SetString(PyExc_ValueError, "Charger does not exist or demand threshold or charge is negative");
+        bp::throw_error_already_set();
+    }
+
+    it->second->set_demandCharge(threshold, charge);
+
+    return 0;
+}
+
+
+bp::dict
+BusManager::get_tariffStats()
+{
+    bp::dict stats, peaks;
+    double demandCost = 0.0;
+    for (auto& chrgr: _chargers){
+        double peak = chrgr.second->get_peakPower();
+        demandCost += std::max(peak - chrgr.second->get_demandThreshold(), 0.0) * chrgr.second->get_demandCharge();
+        peaks[chrgr.first] = peak;
+    }
+    stats["energy_cost"] = _energyCost;
+    stats["demand_cost"] = demandCost;
+    stats["peaks"]       = peaks;
+
+    return stats;
+}
+
+
+int
+BusManager::set_gridSignal(std::shared_ptr<NRG::GridSignal> signal, double costWeight, double carbonWeight)
+{
+    if ( costWeight < 0.0 || carbonWeight < 0.0 ){
+        PyErr_SetString(PyExc_ValueError, "Grid signal weights are negative");
+        bp::throw_error_already_set();
+    }
+    _gridSignal   = signal;
+    _costWeight   = costWeight;
+    _carbonWeight = carbonWeight;
+
+    return 0;
+}
+
+
+bp::dict
+BusManager::get_gridStats()
+{
+    bp::dict stats;
+    stats["energy"]        = _gridEnergy;
+    // Below 1 means charging landed on cheaper and cleaner than average steps
+    stats["charged_index"] = (_gridEnergy > 0.0) ? _gridWeighted / _gridEnergy : 1.0;
+    stats["samples"]       = _gridSignal ? _gridSignal->get_numSamples() : 0;
+
+    return stats;
+}
+
+
+bp::dict
+BusManager::plan_charging(bpn::ndarray const& prices, int startTime)
+{
+    int numPrices = prices.shape(0);
+    if ( numPrices < 1 ){
+        PyErr_SetString(PyExc_ValueError, "Planner needs at least one price");
+        bp::throw_error_already_set();
+    }
+    double* price = reinterpret_cast<double*>(prices.get_data());
+    std::vector<double> signal(price, price + numPrices);
+
+    // Buses are planned independently so they are spread over the worker threads
+    std::vector<BusPtr> buses;
+    for (auto& bus: _buses)
+        buses.push_back(bus.second);
+    std::vector<ChargePlan> plans(buses.size());
+    _pool->parallel_for(buses.size(), [&](int idx){
+        BusPtr const& bus = buses[idx];
+        auto busIt = _schedule->chargeStart.find(bus->get_identifier());
+        if ( busIt == _schedule->chargeStart.end() )
+            return;
+
+        PlanInput input;
+        for (auto& window: busIt->second){
+            input.windowStarts.push_back(window.second);
+            input.windowEnds.push_back(window.first);
+            input.tripEnergy.push_back(get_nextTripEnergy(bus, window.first));
+        }
+        input.energy = (bus->get_stateOfCharge() - bus->get_minSoc()) * bus->get_capacity();
+        input.usable = (bus->get_maxSoc() - bus->get_minSoc()) * bus->get_capacity();
+        input.power  = bus->get_chargeRate() * 60;
+        plans[idx] = plan_bus(input, signal, startTime);
+    });
+
+    std::shared_ptr<std::map<int, ChargePlan>> planMap(new std::map<int, ChargePlan>());
+    double cost = 0.0, shortfall = 0.0;
+    size_t numSlots = 0;
+    for (size_t idx = 0; idx < buses.size(); ++idx){
+        cost      += plans[idx].cost;
+        shortfall += plans[idx].shortfall;
+        numSlots  += plans[idx].times.size();
+        (*planMap)[buses[idx]->get_identifier()] = std::move(plans[idx]);
+    }
+    _plans = planMap;
+
+    bp::dict stats;
+    stats["cost"]      = cost;
+    stats["shortfall"] = shortfall;
+    stats["slots"]     = numSlots;
+
+    return stats;
+}
+
+
+int
+BusManager::swap_bus(int busId, double capacity, double consumptionRate, double chargeRate)
+{
+    auto it = _buses.find(busId);
+    if ( it == _buses.end() || capacity <= 0.0 ){
+        PyErr_SetString(PyExc_ValueError, "Bus does not exist or capacity is not positive");
+        bp::throw_error_already_set();
+    }
+
+    // Buses are never shared with a branch, only their history is; the model block is replaced, not edited
+    BusModel model = *it->second->get_model();
+    model.capacity        = capacity;
+    model.consumptionRate = consumptionRate;
+    model.chargeRate      = chargeRate;
+    it->second->swap_unit(_catalog->find_or_add(model));
+    build_blockPlan(it->second);
+
+    return 0;
+}
+
+
+bp::object
+BusManager::get_checkpoint() const
+{
+    return CKPT::blob_toBytes(save_state());
+}
+
+
+int
+BusManager::restore_checkpoint(bp::object const& blob)
+{
+    if ( restore_state(CKPT::bytes_toBlob(blob)) != 0 ){
+        PyErr_SetString(PyExc_ValueError, "Checkpoint does not match this bus manager");
+        bp::throw_error_already_set();
+    }
+
+    return 0;
+}
+
+
+void
+BusManager::clear_memory()
+{
+    _usageLog.clear();
+    std::fill(_usageLogged.begin(), _usageLogged.end(), 0);
+    _energyChargedTime.clear();
+    _events->reset();
+    _failures->reset();
+    _nextEventTime = 0;
+    _lastSimTime   = 0;
+}
+
+
+int
+BusManager::handle_necessaryCharging(ChargerPtr chrgr, std::vector<PowerClaim>& claims, time_t simTime)
+{
+    std::vector<Priority> const& priorities = _priorities.at(chrgr);
+    std::map<BusPtr, bool> const& necessities = _necessities.at(chrgr);
+
+    // Priorities vector is in order so the most necessary bus gets a plug first
+    for (auto& priority : priorities){
+        BusPtr bus = priority.first;
+        PlugType plugType = bus->get_plugType();
+
+        if ( necessities.at(bus) == false )
+            continue;
+        PlugStatus plug = get_plug(chrgr, bus, simTime);
+        if ( plug == PlugStatus::e_QUEUED ){
+            _failures->record(EVLOG::ePLUG_STARVED, simTime, bus->get_identifier(), chrgr->get_identifier());
+            continue;
+        }
+        if ( plug == PlugStatus::e_CONNECTED ){
+            double chrgRate = chrgr->get_plugPower(bus->get_maxChargePower(_timestep), plugType); // kW
+            claims.push_back(PowerClaim{bus, std::max(priority.second, 1e-6), chrgRate, 0.0});
+        }
+    }
+
+    return 0;
+}
+
+
+int
+BusManager::handle_remainingCharging(ChargerPtr chrgr, std::vector<PowerClaim>& claims, time_t simTime)
+{
+    std::vector<Priority> const& priorities = _priorities.at(chrgr);
+    std::map<BusPtr, bool> const& necessities = _necessities.at(chrgr);
+
+    // Priorities vector is in order so the most necessary bus gets a plug first
+    for (auto& priority : priorities){
+        BusPtr bus = priority.first;
+        PlugType plugType = bus->get_plugType();
+        double chargePriority = priority.second;
+
+        if ( necessities.at(bus) == true || chargePriority <= 0.0 )
+            continue;
+        PlugStatus plug = get_plug(chrgr, bus, simTime);
+        if ( plug == PlugStatus::e_QUEUED ){
+            _events->log(EVLOG::ePLUG_EXHAUSTED, simTime, bus->get_identifier(), chrgr->get_identifier());
+            continue;
+        }
+        if ( plug == PlugStatus::e_CONNECTED ){
+            double chrgRate = chrgr->get_plugPower(bus->get_maxChargePower(_timestep), plugType); // kW
+            claims.push_back(PowerClaim{bus, chargePriority, chrgRate, 0.0});
+        }
+    }
+
+    return 0;
+}
+
+
+int
+BusManager::handle_tariffCharging(ChargerPtr chrgr, std::vector<PowerClaim>& claims, time_t simTime)
+{
+    std::vector<Priority> const& priorities = _priorities.at(chrgr);
+    std::map<BusPtr, bool> const& necessities = _necessities.at(chrgr);
+    std::map<BusPtr, int>& nextDepart = _nextDepart.at(chrgr);
+    double price = _tariff ? _tariff->get_price(simTime) : 0.0;
+
+    // Waiting is only worth it up to each bus's share of the site's demand level
+    double level = std::numeric_limits<double>::infinity();
+    if ( chrgr->get_demandCharge() > 0.0 && !priorities.empty() )
+        level = std::max(chrgr->get_demandThreshold(), chrgr->get_peakPower()) / priorities.size();
+
+    for (auto& priority : priorities){
+        BusPtr bus = priority.first;
+        PlugType plugType = bus->get_plugType();
+        if ( necessities.at(bus) == true || priority.second <= 0.0 )
+            continue;
+
+        // Cheapest hours first, only what cheaper hours before departure can not deliver is charged now
+        int depart = nextDepart[bus];
+        double chrgRate = chrgr->get_plugPower(bus->get_maxChargePower(_timestep), plugType); // kW
+        double need = get_departEnergy(bus, depart) - (bus->get_stateOfCharge() - bus->get_minSoc()) * bus->get_capacity();
+        double cheaper = _tariff ? _tariff->get_cheaperSeconds(simTime + _timestep, depart, price) : 0.0;
+        double wantNow = need - std::min(chrgRate, level) * cheaper / 3600;
+        if ( wantNow <= 0.0 )
+            continue;
+
+        PlugStatus plug = get_plug(chrgr, bus, simTime);
+        if ( plug == PlugStatus::e_QUEUED ){
+            _events->log(EVLOG::ePLUG_EXHAUSTED, simTime, bus->get_identifier(), chrgr->get_identifier());
+            continue;
+        }
+        if ( plug == PlugStatus::e_CONNECTED )
+            claims.push_back(PowerClaim{bus, priority.second, std::min(chrgRate, to_stepPower(wantNow)), 0.0});
+    }
+
+    return 0;
+}
 
-    for (auto& bus: _busSchedule[charger][simTime]){
-        // Get bus ID
+
+int
+BusManager::handle_plannedCharging(ChargerPtr chrgr, std::vector<PowerClaim>& claims, time_t simTime)
+{
+    std::vector<Priority> const& priorities = _priorities.at(chrgr);
+    std::map<BusPtr, bool> const& necessities = _necessities.at(chrgr);
+    // Steps divide a minute (set_timestep) so a step never spans more than one plan slot
+    int slotEnd = simTime - (simTime % PLAN_SLOT) + PLAN_SLOT;
+
+    for (auto& priority : priorities){
+        BusPtr bus = priority.first;
+        PlugType plugType = bus->get_plugType();
+        if ( necessities.at(bus) == true )
+            continue;
+
+        // Power to reach the planned level by the end of the slot corrects for drift from the plan
+        double level;
+        auto planIt = _plans->find(bus->get_identifier());
+        if ( planIt == _plans->end() || !planIt->second.get_target(simTime, level) )
+            continue;
+        double energy = (bus->get_stateOfCharge() - bus->get_minSoc()) * bus->get_capacity();
+        double wantPwr = (level - energy) * 3600 / (slotEnd - simTime);
+        if ( wantPwr <= 0.0 )
+            continue;
+
+        PlugStatus plug = get_plug(chrgr, bus, simTime);
+        if ( plug == PlugStatus::e_QUEUED ){
+            _events->log(EVLOG::ePLUG_EXHAUSTED, simTime, bus->get_identifier(), chrgr->get_identifier());
+            continue;
+        }
+        if ( plug == PlugStatus::e_CONNECTED ){
+            double chrgRate = chrgr->get_plugPower(bus->get_maxChargePower(_timestep), plugType); // kW
+            claims.push_back(PowerClaim{bus, std::max(priority.second, 1e-6), std::min(chrgRate, wantPwr), 0.0});
+        }
+    }
+
+    return 0;
+}
+
+
+int
+BusManager::handle_gridCharging(ChargerPtr chrgr, std::vector<PowerClaim>& claims, time_t simTime, double gridIndex)
+{
+    std::vector<Priority> const& priorities = _priorities.at(chrgr);
+    std::map<BusPtr, bool> const& necessities = _necessities.at(chrgr);
+
+    for (auto& priority : priorities){
+        BusPtr bus = priority.first;
+        PlugType plugType = bus->get_plugType();
+        double chargePriority = priority.second;
+        if ( necessities.at(bus) == true || chargePriority <= 0.0 )
+            continue;
+
+        // Above the mean only the average rate that still makes the departure is drawn
+        double chrgRate = chrgr->get_plugPower(bus->get_maxChargePower(_timestep), plugType); // kW
+        if ( gridIndex > 1.0 )
+            chrgRate = std::min(chrgRate, chargePriority * bus->get_chargeRate() * 60);
+
+        PlugStatus plug = get_plug(chrgr, bus, simTime);
+        if ( plug == PlugStatus::e_QUEUED ){
+            _events->log(EVLOG::ePLUG_EXHAUSTED, simTime, bus->get_identifier(), chrgr->get_identifier());
+            continue;
+        }
+        if ( plug == PlugStatus::e_CONNECTED )
+            claims.push_back(PowerClaim{bus, chargePriority / std::max(gridIndex, 1e-3), chrgRate, 0.0});
+    }
+
+    return 0;
+}
+
+
+double
+BusManager::get_demandRoom(ChargerPtr const& chrgr, double power) const
+{
+    if ( chrgr->get_demandCharge() <= 0.0 )
+        return std::numeric_limits<double>::infinity();
+
+    return std::max(std::max(chrgr->get_demandThreshold(), chrgr->get_peakPower()) - power, 0.0);
+}
+
+
+void
+BusManager::account_costs(time_t simTime, double pwrConsump)
+{
+    // Site power is summed from the buses so smart charging and discharge are counted too
+    for (auto& chrgr: _chargerList){
+        double power = 0.0;
+        for (auto& priority: _priorities.at(chrgr))
+            power += priority.first->get_chargePower(simTime);
+        chrgr->record_power(power);
+    }
+
+    if ( _tariff )
+        _energyCost += _tariff->get_price(simTime) * to_stepEnergy(pwrConsump);
+    if ( _gridSignal ){
+        _gridEnergy   += to_stepEnergy(pwrConsump);
+        _gridWeighted += _gridSignal->get_index(simTime, _costWeight, _carbonWeight) * to_stepEnergy(pwrConsump);
+    }
+}
+
+
+void
+BusManager::dispatch_claims(std::vector<PowerClaim>& claims, double budget, double& pwrConsump, double& energyCharged, time_t simTime)
+{
+    allocate_power(claims, budget);
+
+    // Claims are still in priority order so buses are commanded in the same order as before
+    for (auto& claim: claims){
+        if ( claim.power > 0.0 )
+            charge_bus(claim.bus, claim.power, simTime, pwrConsump, energyCharged);
+    }
+    claims.clear();
+}
+
+
+void
+BusManager::charge_bus(BusPtr bus, double chrgRate, time_t simTime, double& pwrConsump, double& energyCharged)
+{
+    int ret = bus->command_power(chrgRate, _timestep, simTime, PowerType::e_ATCHARGER);
+    if ( ret != 0 ){
+        if ( ret == OVER_MAX_SOC ){
+            double busSoc = bus->get_stateOfCharge();
+            double busCap = bus->get_capacity();
+            double busMaxSoc = bus->get_maxSoc();
+            double energyToCharge = (busMaxSoc - busSoc) * busCap; // kWh
+            _events->log(EVLOG::eSOC_CLAMP, simTime, bus->get_identifier(), energyToCharge);
+            bus->command_power(to_stepPower(energyToCharge), _timestep, simTime, PowerType::e_ATCHARGER);
+            energyCharged += energyToCharge;
+            pwrConsump += to_stepPower(energyToCharge);
+        }
+        else if ( ret == UNDER_MIN_SOC ){
+            _failures->record(EVLOG::eFORCED_CHARGING, simTime, bus->get_identifier(), bus->get_stateOfCharge());
+            bus->command_power(chrgRate, _timestep, simTime, PowerType::e_ATCHARGER, true);
+            energyCharged += to_stepEnergy(chrgRate);
+            pwrConsump += chrgRate;
+        }
+    } else {
+        energyCharged += to_stepEnergy(chrgRate);
+        pwrConsump += chrgRate;
+    }
+}
+
+
+void
+BusManager::allocate_power(std::vector<PowerClaim>& claims, double budget)
+{
+    double demand = 0.0, weight = 0.0;
+    for (auto& claim: claims){
+        demand += claim.maxPower;
+        weight += claim.weight;
+    }
+    if ( demand <= budget ){
+        for (auto& claim: claims)
+            claim.power = claim.maxPower;
+        return;
+    }
+
+    // Water filling, claims saturate in order of maxPower / weight and the rest share the level
+    std::vector<size_t> order(claims.size());
+    for (size_t idx = 0; idx < order.size(); ++idx)
+        order[idx] = idx;
+    std::sort(order.begin(), order.end(), [&claims](size_t lhs, size_t rhs){
+        return claims[lhs].maxPower * claims[rhs].weight < claims[rhs].maxPower * claims[lhs].weight;
+    });
+
+    double remaining = std::max(budget, 0.0);
+    for (auto& idx: order){
+        PowerClaim& claim = claims[idx];
+        claim.power = std::min(claim.maxPower, claim.weight * remaining / weight);
+        remaining  -= claim.power;
+        weight     -= claim.weight;
+    }
+}
+
+
+void
+BusManager::get_chargerBudgets(std::vector<std::vector<PowerClaim>> const& claims, std::vector<double> const& chrgrPwr,
+                               std::vector<double>& budgets)
+{
+    std::map<int, std::vector<PowerClaim>> feederShares;
+    std::map<int, std::vector<int>> feederChargers;
+    std::map<int, double> feederUsed;
+
+    for (size_t idx = 0; idx < _chargerList.size(); ++idx){
+        ChargerPtr const& chrgr = _chargerList[idx];
+        double maxPower = chrgr->get_powerCap();
+        budgets[idx] = maxPower > 0.0 ? std::max(maxPower - chrgrPwr[idx], 0.0) : std::numeric_limits<double>::infinity();
+
+        auto feeder = _feederCaps.find(chrgr->get_feeder());
+        if ( feeder == _feederCaps.end() )
+            continue;
+
+        double demand = 0.0;
+        for (auto& claim: claims[idx])
+            demand += claim.maxPower;
+        feederShares[feeder->first].push_back(PowerClaim{BusPtr(), 1.0, std::min(demand, budgets[idx]), 0.0});
+        feederChargers[feeder->first].push_back(idx);
+        feederUsed[feeder->first] += chrgrPwr[idx];
+    }
+
+    // Feeder headroom is split evenly, chargers that need less hand the rest to the others
+    for (auto& shares: feederShares){
+        allocate_power(shares.second, std::max(_feederCaps.at(shares.first) - feederUsed[shares.first], 0.0));
+        for (size_t pos = 0; pos < shares.second.size(); ++pos)
+            budgets[feederChargers[shares.first][pos]] = shares.second[pos].power;
+    }
+}
+
+
+int
+BusManager::handle_powerRequest(double& pwrConsump, std::vector<double> const& chrgrPwr, double powerRequest, time_t simTime)
+{
+    int ret;
+    double chrgRate, targetPwr;
+    std::vector<Priority> priorities;
+    std::map<BusPtr, bool> necessities;
+
+    // Buses are taken one at a time in priority order so caps are applied as headroom left
+    std::map<ChargerPtr, double> chrgrRoom;
+    std::map<int, double> feederRoom(_feederCaps);
+    for (size_t idx = 0; idx < _chargerList.size(); ++idx){
+        ChargerPtr const& chrgr = _chargerList[idx];
+        double maxPower = chrgr->get_powerCap();
+        chrgrRoom[chrgr] = maxPower > 0.0 ? maxPower - chrgrPwr[idx] : std::numeric_limits<double>::infinity();
+        auto feeder = feederRoom.find(chrgr->get_feeder());
+        if ( feeder != feederRoom.end() )
+            feeder->second -= chrgrPwr[idx];
+    }
+
+    // Calculate Target to hit
+    targetPwr = powerRequest - pwrConsump;
+
+    // Order all available buses by priority
+    merge_priorities(priorities);
+    for(auto& chrgr: _chargerList){
+        auto& appendNecessities = _necessities.at(chrgr);
+        necessities.insert(appendNecessities.begin(), appendNecessities.end());
+    }
+
+    // Highest priorities are charged from the front, discharging buses are taken from the back
+    size_t first = 0, last = priorities.size();
+    while ( std::fabs(targetPwr) >= 1e-5 && first != last ){
+        if ( targetPwr > 0.0 ){
+            auto bus   = priorities[first].first;
+            auto chargePriority = priorities[first].second;
+            PlugType plugType = bus->get_plugType();
+            auto chrgr = _busToCharger[bus];
+
+            auto feeder = feederRoom.find(chrgr->get_feeder());
+            double room = chrgrRoom[chrgr];
+            if ( feeder != feederRoom.end() )
+                room = std::min(room, feeder->second);
+
+            PlugStatus plug = (necessities[bus] || room <= 0.0) ? PlugStatus::e_QUEUED : get_plug(chrgr, bus, simTime);
+            if ( necessities[bus] == false && room > 0.0 && plug == PlugStatus::e_QUEUED )
+                _events->log(EVLOG::ePLUG_EXHAUSTED, simTime, bus->get_identifier(), chrgr->get_identifier());
+            if ( plug == PlugStatus::e_CONNECTED ){
+                chrgRate = std::min(chrgr->get_plugPower(bus->get_maxChargePower(_timestep), plugType), targetPwr);
+                chrgRate = std::min(chrgRate, room);
+
+                double energyCharged = 0.0, before = pwrConsump;
+                charge_bus(bus, chrgRate, simTime, pwrConsump, energyCharged);
+                _totalCharge += energyCharged;
+                targetPwr -= pwrConsump - before;
+                chrgrRoom[chrgr] -= pwrConsump - before;
+                if ( feeder != feederRoom.end() )
+                    feeder->second -= pwrConsump - before;
+            }
+
+            first++;
+        } 
+        else if ( targetPwr < 0.0 ){
+            auto bus   = priorities[last-1].first;
+            auto chargePriority = priorities[last-1].second;
+            PlugType plugType = bus->get_plugType();
+            auto chrgr = _busToCharger[bus];
+
+            chrgRate = std::max(chrgr->get_plugPower(-bus->get_chargeRate()*60, plugType), targetPwr);
+            chrgRate = std::max(chrgRate, chargePriority*bus->get_chargeRate());
+            if ( necessities[bus] == false && chargePriority < 0.0 && is_worthDischarging(bus, chrgRate) &&
+                 get_plug(chrgr, bus, simTime) == PlugStatus::e_CONNECTED ){
+                ret = bus->command_power(chrgRate, _timestep, simTime, PowerType::e_ATCHARGER);
+                if ( ret != 0 ){
+                    if ( ret == OVER_MAX_SOC ){
+                        // Above max SoC and discharging, the command only brings it back down
+                        _events->log(EVLOG::eSOC_CLAMP, simTime, bus->get_identifier(), to_stepEnergy(chrgRate));
+                        bus->command_power(chrgRate, _timestep, simTime, PowerType::e_ATCHARGER, true);
+                        _totalCharge += to_stepEnergy(chrgRate);
+                        pwrConsump += chrgRate;
+                        targetPwr -= chrgRate;
+                    }
+                    else if ( ret == UNDER_MIN_SOC ){
+                        double busSoc = bus->get_stateOfCharge();
+                        double busCap = bus->get_capacity();
+                        double busMinSoc = bus->get_minSoc();
+                        double energyToDschrg = (busSoc - busMinSoc) * busCap; // kWh
+                        _events->log(EVLOG::eSOC_CLAMP, simTime, bus->get_identifier(), -energyToDschrg);
+                        bus->command_power(to_stepPower(energyToDschrg), _timestep, simTime, PowerType::e_ATCHARGER);
+                        _totalCharge += energyToDschrg;
+                        pwrConsump += to_stepPower(energyToDschrg);
+                        targetPwr -= to_stepPower(energyToDschrg);
+                    }
+                } else {
+                    _totalCharge += to_stepEnergy(chrgRate);
+                    pwrConsump += chrgRate;
+                    targetPwr -= chrgRate;
+                }
+            }
+
+            last--;
+        }
+    }
+
+    return 0;
+}
+
+
+bool
+BusManager::is_worthDischarging(BusPtr const& bus, double power) const
+{
+    if ( !_v2gMode )
+        return true;
+
+    double energy = to_stepEnergy(-power);
+    return energy > 0.0 && _v2gValue * energy > bus->get_wearCost(-energy);
+}
+
+
+void
+BusManager::handle_routes(ChargerPtr chrgr, time_t simTime)
+{   
+    bool firstRun = (simTime == 16200);
+    if ( firstRun )
+        return; // No departures for the first timestep
+
+    // Departures only happen on schedule boundaries
+    if ( get_scheduleSlot(simTime - _timestep) == get_scheduleSlot(simTime) )
+        return;
+
+    int busId;
+    double busEff, busTripDist, reqdEnrgForTrip;
+    std::vector<int> const& first = get_scheduledBuses(chrgr, get_scheduleSlot(simTime - _timestep));
+    std::vector<int> const& second = get_scheduledBuses(chrgr, get_scheduleSlot(simTime));
+    std::vector<int> departures(first.size());
+
+    auto it = std::set_difference(first.begin(), first.end(), second.begin(), second.end(), departures.begin());
+    departures.resize(it-departures.begin());
+
+    for (auto& departId: departures){
+        BusPtr const& bus = _buses.at(departId);
         busId = bus->get_identifier();
-        // Get bus SOC
-        busSoc = bus->get_stateOfCharge();
-        // Get bus capacity
-        busCap = bus->get_capacity();
-        // Get bus kWh/mi
+        // Profiled trips are drained as the bus drives, the whole trip must fit above min SoC
+        int tripIdx = get_nextTrip(busId, simTime);
+        if ( tripIdx >= 0 ){
+            reqdEnrgForTrip = get_nextTripEnergy(bus, simTime);
+            if ( bus->get_stateOfCharge() - reqdEnrgForTrip / bus->get_capacity() < bus->get_minSoc() ){
+                _failures->record(EVLOG::eSTRANDED_DEPARTURE, simTime, busId, reqdEnrgForTrip);
+                continue;
+            }
+            bus->start_trip(tripIdx, simTime, _timestep);
+            drain_trip(bus, simTime, false);
+            continue;
+        }
+
+        // Get bus kWh,mi
         busEff = bus->get_consumptionRate();
         // Get bus next travel distance
-        busTripDist = _nextTripDist[busId][nextDepart[bus]];
+        busTripDist = get_nextTripDist(busId, simTime);
         // Calc necessary kWh to make next trip
         reqdEnrgForTrip = busTripDist * busEff;
+
+        int ret = bus->command_power(-reqdEnrgForTrip, 3600, simTime, PowerType::e_ONROUTE);
+        if ( ret != 0 )
+            _failures->record(EVLOG::eSTRANDED_DEPARTURE, simTime, busId, reqdEnrgForTrip);
+    }
+}
+
+
+void
+BusManager::handle_trips(time_t simTime)
+{
+    // A bus back at a charger ends its trip even if the profile runs longer than the schedule gap
+    int slot = get_scheduleSlot(simTime);
+    for (auto& chrgr: _chargerList){
+        for (auto& busId: get_scheduledBuses(chrgr, slot)){
+            BusPtr const& bus = _buses.at(busId);
+            if ( bus->get_trip().tripIdx >= 0 )
+                drain_trip(bus, simTime, true);
+        }
+    }
+
+    for (auto& bus: _buses){
+        if ( bus.second->get_trip().tripIdx >= 0 )
+            drain_trip(bus.second, simTime, false);
+    }
+}
+
+
+void
+BusManager::drain_trip(BusPtr const& bus, time_t simTime, bool finish)
+{
+    TripProgress& trip = bus->get_trip();
+    int duration = _routeEnergy->get_duration(trip.tripIdx);
+    double tripMiles = _routeEnergy->get_tripMiles(trip.tripIdx);
+
+    // A bus back at a charger charges this step, so it drives up to the step before
+    int lastStep = finish ? simTime - _timestep : simTime;
+
+    // One command per step so history matches whether or not steps were skipped
+    for (int ts = trip.lastTime + _timestep; ts <= lastStep; ts += _timestep){
+        int elapsed = ts + _timestep - trip.departTime;
+        bool last = (elapsed >= duration) || (finish && ts + _timestep > lastStep);
+        double miles = last ? tripMiles : _routeEnergy->get_milesAt(trip.tripIdx, elapsed, trip.segment);
+
+        // Departure checked the whole trip so a step may not fail on min SoC
+        double energy = (miles - trip.miles) * bus->get_consumptionRate();
+        bus->command_power(-to_stepPower(energy), _timestep, ts, PowerType::e_ONROUTE, true);
+        trip.miles    = miles;
+        trip.lastTime = ts;
+        if ( last ){
+            trip.tripIdx = -1;
+            return;
+        }
+    }
+
+    // Already drained up to arrival, what is left of the trip goes on the last step driven
+    if ( finish ){
+        double energy = (tripMiles - trip.miles) * bus->get_consumptionRate();
+        bus->command_power(-to_stepPower(energy), _timestep, trip.lastTime, PowerType::e_ONROUTE, true);
+        trip.miles   = tripMiles;
+        trip.tripIdx = -1;
+    }
+}
+
+
+void
+BusManager::merge_priorities(std::vector<Priority>& priorities)
+{
+    // Each charger's list is already sorted so merge them pairwise instead of sorting everything
+    std::vector<std::vector<Priority>> lists;
+    for (auto& chrgr: _chargerList)
+        lists.push_back(_priorities.at(chrgr));
+
+    while ( lists.size() > 1 ){
+        std::vector<std::vector<Priority>> merged((lists.size() + 1) / 2);
+        _pool->parallel_for(merged.size(), [&](int idx){
+            if ( 2*idx + 1 < (int)lists.size() ){
+                merged[idx].reserve(lists[2*idx].size() + lists[2*idx+1].size());
+                std::merge(lists[2*idx].begin(), lists[2*idx].end(), lists[2*idx+1].begin(), lists[2*idx+1].end(),
+                           std::back_inserter(merged[idx]), compare_priority);
+            }
+            else
+                merged[idx].swap(lists[2*idx]);
+        });
+        lists.swap(merged);
+    }
+
+    if ( !lists.empty() )
+        priorities.swap(lists.front());
+}
+
+
+PlugStatus
+BusManager::get_plug(ChargerPtr chrgr, BusPtr bus, time_t simTime)
+{
+    if ( !_queuePlugs )
+        return chrgr->acquire_plug(bus->get_plugType()) ? PlugStatus::e_CONNECTED : PlugStatus::e_QUEUED;
+
+    return chrgr->request_plug(bus->get_identifier(), bus->get_plugType(), simTime);
+}
+
+
+std::vector<int> const&
+BusManager::get_scheduledBuses(ChargerPtr chrgr, int slot) const
+{
+    static std::vector<int> const noBuses;
+    auto chrgrIt = _schedule->busIds.find(chrgr->get_identifier());
+    if ( chrgrIt == _schedule->busIds.end() )
+        return noBuses;
+
+    auto slotIt = chrgrIt->second.find(slot);
+    if ( slotIt == chrgrIt->second.end() )
+        return noBuses;
+
+    return slotIt->second;
+}
+
+
+double
+BusManager::get_nextTripDist(int busId, int departTime) const
+{
+    auto busIt = _schedule->nextTripDist.find(busId);
+    if ( busIt == _schedule->nextTripDist.end() )
+        return 0.0;
+
+    auto tripIt = busIt->second.find(departTime);
+    if ( tripIt == busIt->second.end() )
+        return 0.0;
+
+    return tripIt->second;
+}
+
+
+int
+BusManager::get_nextTrip(int busId, int departTime) const
+{
+    auto busIt = _schedule->nextTrip.find(busId);
+    if ( busIt == _schedule->nextTrip.end() )
+        return -1;
+
+    auto tripIt = busIt->second.find(departTime);
+    if ( tripIt == busIt->second.end() )
+        return -1;
+
+    return tripIt->second;
+}
+
+
+double
+BusManager::get_nextTripEnergy(BusPtr const& bus, int departTime) const
+{
+    int tripIdx = get_nextTrip(bus->get_identifier(), departTime);
+    if ( tripIdx >= 0 )
+        return _routeEnergy->get_tripMiles(tripIdx) * bus->get_consumptionRate();
+
+    return get_nextTripDist(bus->get_identifier(), departTime) * bus->get_consumptionRate();
+}
+
+
+double
+BusManager::get_departEnergy(BusPtr const& bus, int departTime) const
+{
+    double tripEnrg = get_nextTripEnergy(bus, departTime);
+    auto planIt = _blockPlans.find(bus->get_identifier());
+    if ( planIt == _blockPlans.end() )
+        return tripEnrg;
+
+    BlockPlan const& plan = *planIt->second;
+    auto it = std::lower_bound(plan.departs.begin(), plan.departs.end(), departTime);
+    if ( it == plan.departs.end() || *it != departTime )
+        return tripEnrg;
+
+    // A block that needs more than the usable pack still charges to max SoC
+    double usable = (bus->get_maxSoc() - bus->get_minSoc()) * bus->get_capacity();
+    return std::max(tripEnrg, std::min(plan.need[it - plan.departs.begin()], usable));
+}
+
+
+void
+BusManager::build_blockPlan(BusPtr const& bus)
+{
+    auto busIt = _schedule->chargeStart.find(bus->get_identifier());
+    if ( busIt == _schedule->chargeStart.end() ){
+        _blockPlans.erase(bus->get_identifier());
+        return;
+    }
+
+    std::shared_ptr<BlockPlan> plan(new BlockPlan());
+    size_t numTrips = busIt->second.size();
+    std::vector<double> tripSum(numTrips + 1, 0.0), windowSum(numTrips + 1, 0.0);
+    size_t idx = 0;
+    for (auto& window: busIt->second){
+        plan->departs.push_back(window.first);
+        tripSum[idx + 1]   = tripSum[idx] + get_nextTripEnergy(bus, window.first);
+        windowSum[idx + 1] = windowSum[idx] + (window.first - window.second) / 60.0 * bus->get_chargeRate();
+        idx++;
+    }
+
+    // Suffix maximum of T[j+1] - W[j+1] from the last trip back
+    plan->need.resize(numTrips);
+    double worst = -std::numeric_limits<double>::max();
+    for (size_t k = numTrips; k-- > 0; ){
+        worst = std::max(worst, tripSum[k + 1] - windowSum[k + 1]);
+        plan->need[k] = worst - tripSum[k] + windowSum[k + 1];
+    }
+    _blockPlans[bus->get_identifier()] = plan;
+}
+
+
+void
+BusManager::build_blockPlans()
+{
+    _blockPlans.clear();
+    for (auto& bus: _buses)
+        build_blockPlan(bus.second);
+}
+
+
+int
+BusManager::find_nextEventTime(time_t simTime, bool allowSmartCharge)
+{
+    int nextEvent = std::numeric_limits<int>::max();
+    auto it = _schedule->events.upper_bound(simTime);
+    if ( it != _schedule->events.end() )
+        nextEvent = *it;
+
+    // Prices and so tariff charging decisions change at period boundaries
+    if ( _tariff )
+        nextEvent = std::min(nextEvent, _tariff->get_nextChange(simTime));
+
+    // Finished connects and disconnects change which buses can draw power
+    if ( _queuePlugs ){
+        for (auto& chrgr: _chargerList)
+            nextEvent = std::min(nextEvent, chrgr->get_nextPlugEvent());
+    }
+
+    for (auto& chrgr: _priorities){
+        for (auto& priority: chrgr.second){
+            BusPtr bus = priority.first;
+            // Bus has enough energy and will not charge again before it departs
+            if ( priority.second <= 0.0 )
+                continue;
+            // Power request changes every step
+            if ( allowSmartCharge )
+                return simTime + _timestep;
+
+            // Bus is waiting on a plug or was clamped at max SOC
+            double chrgRate = chrgr.first->get_plugPower(bus->get_maxChargePower(_timestep), bus->get_plugType()); // kW
+            if ( bus->get_chargePower(simTime) != chrgRate )
+                return simTime + _timestep;
+
+            // Bus stops charging once it has enough energy for its trip or reaches max SOC
+            double busCap   = bus->get_capacity();
+            double socStep  = (chrgRate * (double)_timestep / 3600) / busCap;
+            double tripEnrg = get_departEnergy(bus, _nextDepart[chrgr.first][bus]);
+            double socLimit = std::min(bus->get_maxSoc(), bus->get_minSoc() + tripEnrg / busCap);
+
+            // Keep one step of margin so rounding never skips past the crossing
+            double steps = std::floor((socLimit - bus->get_stateOfCharge()) / socStep) - 1;
+            if ( steps < 1 )
+                return simTime + _timestep;
+            // Power changes every step once the pack tapers
+            if ( socLimit > bus->get_fullPowerSoc() )
+                return simTime + _timestep;
+
+            if ( simTime + steps*_timestep < nextEvent )
+                nextEvent = simTime + (int)steps*_timestep;
+            bus->hold_power(chrgRate);
+        }
+    }
+
+    return nextEvent;
+}
+
+
+// Compares two priorities. 
+bool 
+BusManager::compare_priority(Priority lhs, Priority rhs){
+    return (lhs.second > rhs.second);
+}
+
+
+int
+BusManager::get_priorities(std::vector<Priority> &priorities, std::map<BusPtr, bool> &necessities, 
+                            ChargerPtr charger, time_t simTime)
+{
+    double busSoc, busCap;
+    double reqdEnrgForTrip, reqdEnrgBeforeTrip, reqdChrgRate, normPriority;
+    // Get departure times for all buses at this charger
+    std::map<BusPtr, int>& nextDepart = _nextDepart.at(charger);
+
+    for (auto& scheduledId: get_scheduledBuses(charger, get_scheduleSlot(simTime))){
+        BusPtr const& bus = _buses.at(scheduledId);
+        // Get bus SOC
+        busSoc = bus->get_stateOfCharge();
+        // Get bus capacity
+        busCap = bus->get_capacity();
+        // Calc necessary kWh to make next trip and still finish the block
+        reqdEnrgForTrip = get_departEnergy(bus, nextDepart[bus]);
         // Calc kWh required minus kWh already have
         reqdEnrgBeforeTrip = reqdEnrgForTrip - (busSoc - bus->get_minSoc()) * busCap;
         // Calc necessary kWh/min to achieve necessary kWh before charge end time
-        normPriority = (reqdEnrgBeforeTrip / ((nextDepart[bus] - simTime)/60)) / bus->get_chargeRate();
+        normPriority = (reqdEnrgBeforeTrip / ((nextDepart[bus] - simTime)/60.0)) / bus->get_chargeRate();
+        // Wear per kWh relative to what discharge earns moves buses with spare energy toward the front
+        if ( _v2gMode && normPriority < 0.0 && _v2gValue > 0.0 ){
+            double stepEnrg = to_stepEnergy(bus->get_chargeRate() * 60);
+            normPriority = std::min(normPriority + bus->get_wearCost(-stepEnrg) / (_v2gValue * stepEnrg), 0.0);
+        }
         // Push bus id and kWh/min to priorities vector
         priorities.push_back(Priority(bus, normPriority));
         // Calc necessary kWh/min for next time step to achieve necessary kWh before charge end time
-        reqdChrgRate = reqdEnrgBeforeTrip / ((nextDepart[bus] - (simTime + 59.999999))/60);
+        reqdChrgRate = reqdEnrgBeforeTrip / ((nextDepart[bus] - (simTime + (_timestep - 0.000001)))/60);
         if ( reqdChrgRate > bus->get_chargeRate() ){
             necessities[bus] = true;
             /*std::cout << "Bus " << bus->get_identifier() << " needs to charge" << std::endl;
@@ -627,28 +2128,23 @@ BusManager::get_priorities(std::vector<Priority> &priorities, std::map<BusPtr, b
 std::map<BUS::BusManager::BusPtr, int>
 BusManager::get_nextDepartureTimes(ChargerPtr charger, int simTime)
 {
-    std::vector<BusPtr> primSet = _busSchedule[charger][simTime];
-    std::vector<BusPtr> currSet;
-    std::vector<BusPtr> departures(primSet.size());
+    simTime = get_scheduleSlot(simTime);
+    std::vector<int> primSet = get_scheduledBuses(charger, simTime);
+    std::vector<int> departures(primSet.size());
     std::map<BusPtr, int> ret;
 
+    // Slots are kept sorted so whatever is left in primSet stays sorted too
     while (primSet.size() > 0){
         simTime += 60;
-        currSet = _busSchedule[charger][simTime];
+        std::vector<int> const& currSet = get_scheduledBuses(charger, simTime);
         departures.resize(primSet.size());
 
-        // Pretty weird to sort by pointer address but it works so ¯\_(ツ)_/¯
-        std::sort(primSet.begin(), primSet.end());
-        std::sort(currSet.begin(), currSet.end());
-
         auto it = std::set_difference(primSet.begin(), primSet.end(), currSet.begin(), currSet.end(), departures.begin());
         departures.resize(it-departures.begin());
 
-        //if ( departures.size() >= 1 )
-        //    std::cout << simTime << ": " << charger->get_name() << " Departures: " << departures.size() << std::endl << "\t";
-        for (auto& bus: departures){
-            ret[bus] = simTime;
-            auto it = std::find (primSet.begin(), primSet.end(), bus);
+        for (auto& busId: departures){
+            ret[_buses.at(busId)] = simTime;
+            auto it = std::find (primSet.begin(), primSet.end(), busId);
             primSet.erase(it);
         }
     }
@@ -660,18 +2156,14 @@ BusManager::get_nextDepartureTimes(ChargerPtr charger, int simTime)
 int
 BusManager::get_nextDepartureTime(ChargerPtr charger, int busId, int simTime)
 {
-    std::map<int, std::vector<BusPtr>> chargingTimes; // Map of charging times and busses at those times
-    chargingTimes = _busSchedule[charger];
-
-    int srchTime = simTime;
-    BusPtr srchBus = _buses[busId];
-    auto it = std::find(chargingTimes[srchTime].begin(), chargingTimes[srchTime].end(), srchBus);
-    assert(it != chargingTimes[srchTime].end());
+    int srchTime = get_scheduleSlot(simTime);
+    std::vector<int> const* slotBuses = &get_scheduledBuses(charger, srchTime);
+    assert(std::binary_search(slotBuses->begin(), slotBuses->end(), busId));
 
     // Find where bus has left the charging station
-    while( it != chargingTimes[srchTime].end() ){
+    while( std::binary_search(slotBuses->begin(), slotBuses->end(), busId) ){
         srchTime += 60;
-        it = std::find(chargingTimes[srchTime].begin(), chargingTimes[srchTime].end(), srchBus);
+        slotBuses = &get_scheduledBuses(charger, srchTime);
     }
 
     return srchTime;
@@ -681,17 +2173,62 @@ BusManager::get_nextDepartureTime(ChargerPtr charger, int busId, int simTime)
 } /** namespace BUS */
 
 
+int
+run_releaseGil(BUS::BusManager& busManager, double powerRequest, int mode, time_t simTime)
+{
+    ReleaseGil release;
+    return busManager.run(powerRequest, mode, simTime);
+}
+
+
 BOOST_PYTHON_MODULE(BusManager)
 {
     bpn::initialize();
     Py_Initialize();
 
+    // Phase timing is shared by the module's managers, so clearing it is not left to any one of them
+    bp::def("reset_stats", &PROF::reset);
+
     bp::class_<BUS::BusManager>("BusManager")
         .def("init_chargers", &BUS::BusManager::init_chargers)
         .def("init_buses",    &BUS::BusManager::init_buses)
         .def("init_schedule", &BUS::BusManager::init_schedule)
-        .def("run",           &BUS::BusManager::run)
+        .def("run",           run_releaseGil)
         .def("file_dump",     &BUS::BusManager::file_dump)
         .def("clear_memory",  &BUS::BusManager::clear_memory)
+        .def("set_timestep",  &BUS::BusManager::set_timestep)
+        .def("set_numThreads", &BUS::BusManager::set_numThreads)
+        .def("serve",         &BUS::BusManager::serve)
+        .def("get_stats",     &BUS::BusManager::get_stats)
+        .def("set_traceFile", &BUS::BusManager::set_traceFile)
+        .def("get_eventCounts", &BUS::BusManager::get_eventCounts)
+        .def("set_eventLog",  &BUS::BusManager::set_eventLog)
+        .def("get_failureCounts",  &BUS::BusManager::get_failureCounts)
+        .def("get_failureRecords", &BUS::BusManager::get_failureRecords)
+        .def("is_infeasible", &BUS::BusManager::is_infeasible)
+        .def("get_checkpoint", &BUS::BusManager::get_checkpoint)
+        .def("restore_checkpoint", &BUS::BusManager::restore_checkpoint)
+        .def("fork",          &BUS::BusManager::fork)
+        .def("set_chargerPlugs", &BUS::BusManager::set_chargerPlugs)
+        .def("swap_bus",      &BUS::BusManager::swap_bus)
+        .def("set_chargeCurve", &BUS::BusManager::set_chargeCurve)
+        .def("set_plugOverheads", &BUS::BusManager::set_plugOverheads)
+        .def("set_maxPlugPower", &BUS::BusManager::set_maxPlugPower)
+        .def("get_plugStats", &BUS::BusManager::get_plugStats)
+        .def("set_chargerCap", &BUS::BusManager::set_chargerCap)
+        .def("set_feederCap", &BUS::BusManager::set_feederCap)
+        .def("set_routeModel", &BUS::BusManager::set_routeModel)
+        .def("init_routeEnergy", &BUS::BusManager::init_routeEnergy)
+        .def("assign_trips",  &BUS::BusManager::assign_trips)
+        .def("set_degradation", &BUS::BusManager::set_degradation)
+        .def("set_v2gValue",  &BUS::BusManager::set_v2gValue)
+        .def("get_degradationStats", &BUS::BusManager::get_degradationStats)
+        .def("set_tariff",    &BUS::BusManager::set_tariff)
+        .def("set_demandCharge", &BUS::BusManager::set_demandCharge)
+        .def("get_tariffStats", &BUS::BusManager::get_tariffStats)
+        .def("plan_charging", &BUS::BusManager::plan_charging)
+        .def("set_gridSignal", &BUS::BusManager::set_gridSignal)
+        .def("get_gridStats", &BUS::BusManager::get_gridStats)
+        .def("get_nextEventTime", &BUS::BusManager::get_nextEventTime)
     ;
 }
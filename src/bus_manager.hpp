@@ -3,8 +3,15 @@
 
 #include "bus.hpp"
 #include "charger.hpp"
+#include "thread_pool.hpp"
+#include "failure_ledger.hpp"
+#include "route_energy.hpp"
+#include "tariff.hpp"
+#include "charge_planner.hpp"
+#include "grid_signal.hpp"
 
 #include <map>
+#include <set>
 #include <boost/python.hpp>
 #include <boost/python/numpy.hpp>
 #include <boost/python/stl_iterator.hpp>
@@ -23,6 +30,12 @@ public:
     BusManager();
     ~BusManager();
 
+    /** Step size and history slot width in seconds, call before init_buses */
+    int set_timestep(int timestep, int historyInterval);
+
+    /** Chargers are stepped in parallel across numThreads workers */
+    int set_numThreads(int numThreads);
+
     int init_chargers(bpn::ndarray const& chargerIds, bpn::ndarray const& chargerNames,
                     bpn::ndarray const& numberPlugs, bpn::ndarray const& plugTypes);
 
@@ -36,36 +49,249 @@ public:
 
     int run(double powerRequest, int mode, time_t simTime);
 
+    int get_nextEventTime() const {return _nextEventTime;}
+    int get_timestep() const {return _timestep;}
+    int get_lastSimTime() const {return _lastSimTime;}
+    double get_lastPwrConsump() const {return _lastPwrConsump;}
+    std::map<int, BusPtr> const& get_buses() const {return _buses;}
+    std::map<int, ChargerPtr> const& get_chargers() const {return _chargers;}
+
+    /** Runs as a co-simulation daemon on a unix socket until told to shut down */
+    int serve(std::string socketPath, int mode, int maxStepsPerPoll);
+
     void file_dump();
 
     void clear_memory();
 
+    /**
+     * Per phase timing totals and histograms, summed over every manager of this module and never
+     * cleared by clear_memory. The module level reset_stats clears them. The trace is written
+     * by file_dump when set.
+     */
+    bp::dict get_stats();
+    void set_traceFile(std::string path);
+
+    /** This manager's counts per event type and this module's event file, an empty path closes it */
+    bp::dict get_eventCounts();
+    int set_eventLog(std::string path);
+
+    /** Per run failure counts and records, sweeps can stop once is_infeasible is true */
+    bp::dict get_failureCounts();
+    bp::list get_failureRecords();
+    bool is_infeasible() const {return _failures->is_infeasible();}
+
+    /**
+     * Everything that changes while running as a binary blob. A blob restores into a manager
+     * initialised from the same chargers, buses and schedule, including one that has run since.
+     */
+    std::string save_state() const;
+    int restore_state(std::string const& blob);
+    bp::object get_checkpoint() const;
+    int restore_checkpoint(bp::object const& blob);
+
+    /**
+     * Branch of this manager at its current step. The schedule is shared, chargers and buses
+     * are copied and buses share their history with the parent until either one records a step.
+     * Parent and branches may then be run from different threads.
+     */
+    BusManager fork() const;
+
+    /** What-if changes, they only affect this manager and not its parent or other branches */
+    int set_chargerPlugs(int chargerId, int plugType, int numPlugs);
+    int swap_bus(int busId, double capacity, double consumptionRate, double chargeRate);
+
+    /** CC/CV taper for the given buses, power factors are fractions of each bus's rated charge power */
+    int set_chargeCurve(bpn::ndarray const& busIds, bpn::ndarray const& socPoints, bpn::ndarray const& powerFactors);
+
+    /**
+     * Plug queueing, used when the run mode has PLUG_QUEUE set. Connecting and disconnecting take
+     * the overhead in seconds, maxPower in kW caps every plug of a type and zero removes the cap.
+     */
+    int set_plugOverheads(int connectTime, int disconnectTime);
+    int set_maxPlugPower(int plugType, double maxPower);
+    bp::dict get_plugStats();
+
+    /**
+     * Power caps in kW, a site cap limits one charger and a feeder cap the chargers listed on it.
+     * Capped power is water-filled across connected buses weighted by their charge priority.
+     */
+    int set_chargerCap(int chargerId, double maxPower);
+    int set_feederCap(int feederId, double maxPower, bpn::ndarray const& chargerIds);
+
+    /**
+     * Trip energy profiles from GTFS stops. The model applies to tables built after it is set,
+     * trips are then assigned to the departure at the end of each scheduled charge. Buses drain
+     * an assigned trip step by step, other departures still take their whole trip at once.
+     */
+    int set_routeModel(double cruiseSpeed, double dwellTime, double stopDelay, double stopMiles,
+                       double climbMiles, double regenFraction, double circuity);
+    int init_routeEnergy(bpn::ndarray const& stopLats, bpn::ndarray const& stopLons, bpn::ndarray const& stopElevs,
+                         bpn::ndarray const& tripOffsets, bpn::ndarray const& tripStops);
+    int assign_trips(bpn::ndarray const& busIds, bpn::ndarray const& departTimes, bpn::ndarray const& tripIdxs);
+
+    /**
+     * Battery wear, counted for every bus with incremental rainflow. With ALLOW_DISCHARGE in the
+     * run mode discharge is only dispatched when value ($/kWh) beats the wear it causes, and wear
+     * makes buses with spare energy less eager to discharge. Wear parameters are per bus model.
+     */
+    int set_degradation(bpn::ndarray const& busIds, double packCost, double cycleLife, double wearExponent);
+    int set_v2gValue(double value);
+    bp::dict get_degradationStats();
+
+    /**
+     * Time of use prices and per site demand charges. With TARIFF_CHARGE in the run mode buses
+     * that are not short of time charge only the energy cheaper hours before they leave can not
+     * cover, and only up to the site's demand level. Costs are accounted in every mode.
+     */
+    int set_tariff(bpn::ndarray const& periodStarts, bpn::ndarray const& prices);
+    int set_demandCharge(int chargerId, double threshold, double charge);
+    bp::dict get_tariffStats();
+
+    /**
+     * Plans every bus's charging for the rest of the day against a price per minute from
+     * startTime, a renewable signal can be passed negated. With PLANNED_CHARGE in the run mode
+     * buses follow the plan, topping up to the planned level when they fall behind it.
+     */
+    bp::dict plan_charging(bpn::ndarray const& prices, int startTime);
+
+    /**
+     * Marginal cost and emissions published by a UtilityManager. With GRID_SIGNAL in the run mode
+     * buses that are not short of time charge at full rate when the weighted signal is at or
+     * below its mean and only at the rate their departure needs above it, and their claims are
+     * weighted by the inverse of the signal.
+     */
+    int set_gridSignal(std::shared_ptr<NRG::GridSignal> signal, double costWeight, double carbonWeight);
+    bp::dict get_gridStats();
+
 private:
     double _totalCharge;
+    int _timestep;
+    int _historyInterval;
     std::map<int, BusPtr> _buses;
     std::map<int, ChargerPtr> _chargers;
-    std::map<ChargerPtr, std::map<int, std::vector<BusPtr>>> _busSchedule;
+    struct Schedule {
+        std::map<int, std::map<int, std::vector<int>>> busIds;        /** Sorted ids of buses at each charger id per minute */
+        std::map<int, std::map<int, double>> nextTripDist;            /** Miles driven after each charge by bus id */
+        std::map<int, std::map<int, int>> nextTrip;                   /** Profiled trip after each charge by bus id */
+        std::map<int, std::map<int, int>> chargeStart;                /** Start of each charge by bus id and charge end */
+        std::set<int> events;                                         /** Arrival and departure times */
+    };
+    std::shared_ptr<Schedule const> _schedule;
+    std::vector<ChargerPtr> _chargerList;
+    std::shared_ptr<ThreadPool> _pool;
+    std::shared_ptr<EVLOG::EventCounter> _events;
+    std::shared_ptr<EVLOG::FailureLedger> _failures;
+    std::shared_ptr<BusCatalog> _catalog; /** Shared with forks, only ever appended */
+    std::map<int, double> _feederCaps;
+    RouteModel _routeModel;
+    std::shared_ptr<RouteEnergy const> _routeEnergy; /** Built once and shared with forks */
+
+    /**
+     * Lookahead over the rest of a bus's block. With T and W the prefix sums of trip energy and
+     * of what each charge window can add at full rate, the kWh above min SoC needed when leaving
+     * on trip k is max over j >= k of T[j+1] - W[j+1] - T[k] + W[k+1], kept as a suffix maximum.
+     */
+    struct BlockPlan {
+        std::vector<int> departs; /** Charge end times in order */
+        std::vector<double> need; /** kWh above min SoC needed at each departure */
+    };
+    std::map<int, std::shared_ptr<BlockPlan const>> _blockPlans; /** By bus id, shared with forks */
+
+    // Event driven stepping
+    int _nextEventTime;
+    int _lastSimTime;
+    double _lastPwrConsump; /** kW, skipped steps repeat it so it is not rounded */
+    bool _queuePlugs;
+    bool _v2gMode;
+    double _v2gValue; /** $/kWh paid for energy discharged to the grid */
+    std::shared_ptr<Tariff const> _tariff;
+    std::shared_ptr<std::map<int, ChargePlan> const> _plans; /** By bus id, shared with forks */
+    double _energyCost;
+    std::shared_ptr<NRG::GridSignal> _gridSignal; /** Shared with forks until set again */
+    double _costWeight;
+    double _carbonWeight;
+    double _gridEnergy;   /** kWh charged while a signal was set */
+    double _gridWeighted; /** The same kWh times the signal index they were charged at */
 
     // Unique for each timestep
     std::map<BusPtr, ChargerPtr> _busToCharger;
-    std::map<int, std::map<int, double>> _nextTripDist;
     std::map<ChargerPtr, std::map<BusPtr, int>> _nextDepart;
     std::map<ChargerPtr, std::vector<Priority>> _priorities;
     std::map<ChargerPtr, std::map<BusPtr, bool>> _necessities;
 
     // Time Series Data per Charging Station
-    std::vector<std::shared_ptr<std::map<ChargerPtr, std::map<PlugType, int>>>> _chrgrsUsedTime;
+    /** Plugs in use at a charger from simTime until the next delta for the same charger and plug type */
+    struct UsageDelta {
+        int32_t  simTime;
+        uint16_t chargerIdx;
+        uint8_t  plugType;
+        uint16_t inUse;
+    };
+    std::vector<UsageDelta> _usageLog;
+    std::vector<uint16_t> _usageLogged; /** Last logged count per charger index and plug type */
     std::vector<std::shared_ptr<std::map<ChargerPtr, double>>> _energyChargedTime;
 
     
-    int handle_necessaryCharging(double& pwrConsump, std::map<ChargerPtr, std::map<PlugType, int>> *chrgrsUsed, time_t simTime);
-    int handle_remainingCharging(double& pwrConsump, std::map<ChargerPtr, std::map<PlugType, int>> *chrgrsUsed, time_t simTime);
-    int handle_powerRequest(double& pwrConsump, std::map<ChargerPtr, std::map<PlugType, int>> *chrgrsUsed, double powerRequest, time_t simTime);
+    /** Power a bus asks for at its charger, weight is its charge priority */
+    struct PowerClaim {
+        BusPtr bus;
+        double weight;
+        double maxPower;
+        double power;
+    };
+
+    /** Per charger handlers only touch buses at that charger so they may run concurrently */
+    int handle_necessaryCharging(ChargerPtr chrgr, std::vector<PowerClaim>& claims, time_t simTime);
+    int handle_remainingCharging(ChargerPtr chrgr, std::vector<PowerClaim>& claims, time_t simTime);
+    int handle_tariffCharging(ChargerPtr chrgr, std::vector<PowerClaim>& claims, time_t simTime);
+    int handle_plannedCharging(ChargerPtr chrgr, std::vector<PowerClaim>& claims, time_t simTime);
+    int handle_gridCharging(ChargerPtr chrgr, std::vector<PowerClaim>& claims, time_t simTime, double gridIndex);
+    /** kW a site can add without raising its demand peak */
+    double get_demandRoom(ChargerPtr const& chrgr, double power) const;
+    void account_costs(time_t simTime, double pwrConsump);
+    void dispatch_claims(std::vector<PowerClaim>& claims, double budget, double& pwrConsump, double& energyCharged, time_t simTime);
+    void charge_bus(BusPtr bus, double chrgRate, time_t simTime, double& pwrConsump, double& energyCharged);
+    /** True when discharging at power (kW, negative) this step earns more than the wear it causes */
+    bool is_worthDischarging(BusPtr const& bus, double power) const;
+    int handle_powerRequest(double& pwrConsump, std::vector<double> const& chrgrPwr, double powerRequest, time_t simTime);
     void handle_charging(double powerRequest, time_t simTime);
-    void handle_routes(time_t simTime);
+    void handle_routes(ChargerPtr chrgr, time_t simTime);
+    /** Drains buses on profiled trips up to simTime, buses back at a charger finish their trip */
+    void handle_trips(time_t simTime);
+    void drain_trip(BusPtr const& bus, time_t simTime, bool finish);
+
+    void reduce_chargerTotals(double& pwrConsump, std::vector<double> const& chrgrPwr, std::vector<double> const& chrgrEnergy);
+    void merge_priorities(std::vector<Priority>& priorities);
+    double get_nextTripDist(int busId, int departTime) const;
+    int get_nextTrip(int busId, int departTime) const;
+    /** kWh the bus needs for the trip leaving at departTime, from its profile when it has one */
+    double get_nextTripEnergy(BusPtr const& bus, int departTime) const;
+    /** kWh above min SoC the bus should hold at departTime to finish its block, O(log n) */
+    double get_departEnergy(BusPtr const& bus, int departTime) const;
+    /** Rebuilt whenever trip energies, charge windows or the bus model change */
+    void build_blockPlan(BusPtr const& bus);
+    void build_blockPlans();
+    std::vector<int> const& get_scheduledBuses(ChargerPtr chrgr, int slot) const;
+    PlugStatus get_plug(ChargerPtr chrgr, BusPtr bus, time_t simTime);
+    void log_chargerUsage(time_t simTime);
+    void init_chargerList();
+
+    /** Returns the next time at which charging decisions can change and holds charging buses until then */
+    int find_nextEventTime(time_t simTime, bool allowSmartCharge);
+
+    /** kWh delivered in one step at power kW and the kW needed to deliver energy kWh in one step */
+    double to_stepEnergy(double power) const {return power / (3600 / _timestep);}
+    double to_stepPower(double energy) const {return energy * (3600 / _timestep);}
+    bool is_historyStep(time_t simTime) const {return ((simTime - 16200) % _historyInterval) == 0;}
+    static int get_scheduleSlot(time_t simTime) {return simTime - (simTime % 60);}
 
     static bool compare_priority(Priority lhs, Priority rhs);
 
+    /** Sets power on every claim so their sum stays within budget, O(n log n) */
+    static void allocate_power(std::vector<PowerClaim>& claims, double budget);
+    void get_chargerBudgets(std::vector<std::vector<PowerClaim>> const& claims, std::vector<double> const& chrgrPwr,
+                            std::vector<double>& budgets);
+
     /** Returns a list of buses that require charging sorted by the rate at which they need to charge in kWh/min */
     int get_priorities(std::vector<Priority> &priorities, std::map<BusPtr, bool> &necessities, 
                         ChargerPtr charger, time_t simTime);
@@ -0,0 +1,73 @@
+#include "bus_model.hpp"
+
+namespace BUS {
+
+BusModelPtr
+BusCatalog::find_or_add(BusModel const& model)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    // A fleet has a handful of models so a linear scan is enough
+    for (auto& existing: _models){
+        if ( existing->capacity == model.capacity && existing->consumptionRate == model.consumptionRate &&
+             existing->chargeRate == model.chargeRate && existing->minSoc == model.minSoc &&
+             existing->maxSoc == model.maxSoc && existing->plugType == model.plugType &&
+             existing->packCost == model.packCost && existing->cycleLife == model.cycleLife &&
+             existing->wearExponent == model.wearExponent &&
+             existing->curveIdx == model.curveIdx )
+            return existing;
+    }
+
+    BusModel* added = new BusModel(model);
+    added->index = _models.size();
+    added->chargeCurve.reset();
+    if ( model.curveIdx >= 0 && model.curveIdx < (int)_curves.size() )
+        added->chargeCurve = _curves[model.curveIdx];
+    else
+        added->curveIdx = -1;
+    _models.push_back(BusModelPtr(added));
+
+    return _models.back();
+}
+
+
+BusModelPtr
+BusCatalog::get_model(int index) const
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if ( index < 0 || index >= (int)_models.size() )
+        return BusModelPtr();
+
+    return _models[index];
+}
+
+
+size_t
+BusCatalog::get_numModels() const
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    return _models.size();
+}
+
+
+int
+BusCatalog::add_curve(std::shared_ptr<ChargeCurve const> curve)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    _curves.push_back(curve);
+
+    return _curves.size() - 1;
+}
+
+
+size_t
+BusCatalog::get_numCurves() const
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    return _curves.size();
+}
+
+
+} /** namespace */
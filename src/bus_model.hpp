@@ -0,0 +1,54 @@
+#ifndef BUSMODEL_H
+#define BUSMODEL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "charger.hpp"
+#include "charge_curve.hpp"
+
+namespace BUS {
+
+/** Parameters shared by every bus of one vehicle model, never changed once in a catalog */
+struct BusModel {
+    double   capacity;        /** kWh                         */
+    double   consumptionRate; /** kWh/mi                      */
+    double   chargeRate;      /** kWh/min                     */
+    double   minSoc;
+    double   maxSoc;
+    PlugType plugType;
+    double   packCost;        /** $ per kWh of capacity to replace the pack              */
+    double   cycleLife;       /** Full cycles at 100% depth before the pack is replaced  */
+    double   wearExponent;    /** Damage of a cycle grows with its depth to this power  */
+    int      curveIdx;        /** Index of the charge curve in the catalog, -1 charges flat out */
+    int      index;           /** Position in the catalog, set when the model is added */
+    std::shared_ptr<ChargeCurve const> chargeCurve;
+};
+
+using BusModelPtr = std::shared_ptr<BusModel const>;
+
+/**
+ * Distinct vehicle models of a fleet. Models and curves are only ever appended so indexes stay
+ * valid, the catalog is shared between a manager and its forks so adding is locked.
+ */
+class BusCatalog
+{
+public:
+    /** Returns the model with the same parameters and curve, adding it when there is none */
+    BusModelPtr find_or_add(BusModel const& model);
+    BusModelPtr get_model(int index) const;
+    size_t get_numModels() const;
+
+    int add_curve(std::shared_ptr<ChargeCurve const> curve);
+    size_t get_numCurves() const;
+
+private:
+    mutable std::mutex _lock;
+    std::vector<BusModelPtr> _models;
+    std::vector<std::shared_ptr<ChargeCurve const>> _curves;
+};
+
+}
+
+
+#endif /** BUSMODEL_H */
@@ -0,0 +1,95 @@
+#include "charge_curve.hpp"
+#include <algorithm>
+#include <math.h>
+
+namespace BUS {
+
+ChargeCurve::ChargeCurve(std::vector<double> const& socPoints, std::vector<double> const& powerFactors)
+{
+    // Breakpoints are linearly interpolated onto the table, flat beyond the first and last point
+    size_t point = 0;
+    for (int idx = 0; idx <= CURVE_SEGMENTS; ++idx){
+        double soc = (double)idx / CURVE_SEGMENTS;
+        while ( point + 1 < socPoints.size() && socPoints[point + 1] <= soc )
+            point++;
+
+        double factor;
+        if ( soc <= socPoints.front() )
+            factor = powerFactors.front();
+        else if ( point + 1 >= socPoints.size() )
+            factor = powerFactors.back();
+        else {
+            double frac = (soc - socPoints[point]) / (socPoints[point + 1] - socPoints[point]);
+            factor = powerFactors[point] + frac * (powerFactors[point + 1] - powerFactors[point]);
+        }
+        _factors[idx] = std::min(std::max(factor, 0.0), 1.0);
+    }
+
+    _fullPowerSoc = 0.0;
+    for (int idx = 0; idx < CURVE_SEGMENTS && _factors[idx + 1] >= 1.0 && _factors[idx] >= 1.0; ++idx)
+        _fullPowerSoc = (double)(idx + 1) / CURVE_SEGMENTS;
+}
+
+
+double
+ChargeCurve::get_powerFactor(double soc) const
+{
+    double pos = std::min(std::max(soc, 0.0), 1.0) * CURVE_SEGMENTS;
+    int seg = std::min((int)pos, CURVE_SEGMENTS - 1);
+    double frac = pos - seg;
+
+    return _factors[seg] + frac * (_factors[seg + 1] - _factors[seg]);
+}
+
+
+double
+ChargeCurve::get_stepEnergy(double soc, double power, double ratedPower, double capacity, double seconds) const
+{
+    double startSoc = soc;
+    double scale = 3600.0 * capacity; // kW seconds per unit of SoC
+    soc = std::max(soc, 0.0);
+    int seg = std::min((int)(soc * CURVE_SEGMENTS), CURVE_SEGMENTS - 1);
+
+    // Each pass covers the rest of a segment or up to where the curve crosses the requested power
+    for (int pass = 0; pass < 4*CURVE_SEGMENTS && seconds > 0.0 && seg < CURVE_SEGMENTS; ++pass){
+        double segEnd = (double)(seg + 1) / CURVE_SEGMENTS;
+        double slope  = (_factors[seg + 1] - _factors[seg]) * CURVE_SEGMENTS * ratedPower; // kW per unit SoC
+        double base   = _factors[seg] * ratedPower - slope * ((double)seg / CURVE_SEGMENTS);
+        double curveNow = base + slope * soc;
+
+        bool limited = (curveNow < power || (curveNow == power && slope < 0.0));
+        double endSoc = segEnd;
+        if ( (limited && slope > 0.0) || (!limited && slope < 0.0) )
+            endSoc = std::min(segEnd, (power - base) / slope);
+        if ( limited && curveNow <= 0.0 )
+            break;
+
+        // Constant power moves SoC linearly, on the curve dP/dt is proportional to P so it is exponential
+        double dt, curveEnd = base + slope * endSoc;
+        if ( !limited )
+            dt = (endSoc - soc) * scale / power;
+        else if ( fabs(slope) < 1e-12 )
+            dt = (endSoc - soc) * scale / curveNow;
+        else
+            dt = (curveEnd > 0.0) ? scale / slope * log(curveEnd / curveNow) : seconds;
+
+        if ( dt >= seconds ){
+            if ( !limited )
+                soc += power * seconds / scale;
+            else if ( fabs(slope) < 1e-12 )
+                soc += curveNow * seconds / scale;
+            else
+                soc = (curveNow * exp(slope * seconds / scale) - base) / slope;
+            break;
+        }
+
+        seconds -= dt;
+        soc = endSoc;
+        if ( endSoc >= segEnd )
+            seg++;
+    }
+
+    return (soc - startSoc) * capacity;
+}
+
+} /** namespace */
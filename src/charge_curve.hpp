@@ -0,0 +1,40 @@
+#ifndef CHARGECURVE_H
+#define CHARGECURVE_H
+
+#include <vector>
+
+namespace BUS {
+
+#define CURVE_SEGMENTS 100
+
+/**
+ * Charging curve of a bus model, the most power a pack accepts at each SoC as a fraction of its
+ * rated charge power. Breakpoints are sampled once into a uniform table so lookups are an index
+ * and a lerp, and energy over a step is integrated in closed form segment by segment.
+ */
+class ChargeCurve
+{
+public:
+    /** socPoints increasing in [0, 1], power factors are clamped to [0, 1] */
+    ChargeCurve(std::vector<double> const& socPoints, std::vector<double> const& powerFactors);
+
+    double get_powerFactor(double soc) const;
+
+    /** Highest SoC up to which the pack takes full rated power */
+    double get_fullPowerSoc() const {return _fullPowerSoc;}
+
+    /**
+     * kWh delivered over seconds starting at soc when asking for power (kW), the pack takes
+     * the lower of power and the curve at every instant
+     */
+    double get_stepEnergy(double soc, double power, double ratedPower, double capacity, double seconds) const;
+
+private:
+    double _factors[CURVE_SEGMENTS + 1];
+    double _fullPowerSoc;
+};
+
+}
+
+
+#endif /** CHARGECURVE_H */
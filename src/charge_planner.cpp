@@ -0,0 +1,165 @@
+#include "charge_planner.hpp"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace BUS {
+
+/** Range add and range max over slot levels */
+class LevelTree
+{
+public:
+    explicit LevelTree(std::vector<double> const& levels)
+    :
+        _size(1)
+    {
+        while ( _size < levels.size() )
+            _size *= 2;
+        _max.assign(2*_size, -std::numeric_limits<double>::infinity());
+        _add.assign(2*_size, 0.0);
+        for (size_t idx = 0; idx < levels.size(); ++idx)
+            _max[_size + idx] = levels[idx];
+        for (size_t node = _size - 1; node > 0; --node)
+            _max[node] = std::max(_max[2*node], _max[2*node + 1]);
+    }
+
+    void add(size_t first, size_t last, double value) {add(1, 0, _size, first, last, value);}
+    double get_max(size_t first, size_t last) const {return get_max(1, 0, _size, first, last);}
+
+private:
+    size_t _size;
+    std::vector<double> _max; /** Max of the node's range not counting adds of its ancestors */
+    std::vector<double> _add;
+
+    void add(size_t node, size_t lo, size_t hi, size_t first, size_t last, double value) {
+        if ( last <= lo || hi <= first )
+            return;
+        if ( first <= lo && hi <= last ){
+            _max[node] += value;
+            _add[node] += value;
+            return;
+        }
+        size_t mid = (lo + hi) / 2;
+        add(2*node, lo, mid, first, last, value);
+        add(2*node + 1, mid, hi, first, last, value);
+        _max[node] = std::max(_max[2*node], _max[2*node + 1]) + _add[node];
+    }
+
+    double get_max(size_t node, size_t lo, size_t hi, size_t first, size_t last) const {
+        if ( last <= lo || hi <= first )
+            return -std::numeric_limits<double>::infinity();
+        if ( first <= lo && hi <= last )
+            return _max[node];
+        size_t mid = (lo + hi) / 2;
+        return std::max(get_max(2*node, lo, mid, first, last), get_max(2*node + 1, mid, hi, first, last)) + _add[node];
+    }
+};
+
+
+bool
+ChargePlan::get_target(int simTime, double& level) const
+{
+    int slot = simTime - (simTime % PLAN_SLOT);
+    auto it = std::lower_bound(times.begin(), times.end(), slot);
+    if ( it == times.end() || *it != slot )
+        return false;
+
+    level = levels[it - times.begin()];
+    return true;
+}
+
+
+ChargePlan
+plan_bus(PlanInput const& input, std::vector<double> const& prices, int startTime)
+{
+    ChargePlan plan;
+
+    // Slots every PLAN_SLOT inside the windows, levels start as if the bus never charged
+    std::vector<int> slotTimes;
+    std::vector<double> slotPrices, levels;
+    std::vector<size_t> firstAfter(input.windowEnds.size()); /** First slot after each departure */
+    std::vector<double> departLevel(input.windowEnds.size());
+    double level = std::min(input.energy, input.usable);
+    for (size_t win = 0; win < input.windowEnds.size(); ++win){
+        // Trips already driven are in the starting energy
+        if ( input.windowEnds[win] <= startTime ){
+            firstAfter[win] = slotTimes.size();
+            departLevel[win] = level;
+            continue;
+        }
+        int start = std::max(input.windowStarts[win], startTime);
+        start += (PLAN_SLOT - start % PLAN_SLOT) % PLAN_SLOT;
+        for (int time = start; time + PLAN_SLOT <= input.windowEnds[win]; time += PLAN_SLOT){
+            size_t priceIdx = std::min((size_t)std::max((time - startTime) / PLAN_SLOT, 0), prices.size() - 1);
+            slotTimes.push_back(time);
+            slotPrices.push_back(prices.empty() ? 0.0 : prices[priceIdx]);
+            levels.push_back(level);
+        }
+        firstAfter[win] = slotTimes.size();
+        departLevel[win] = level;
+        level -= input.tripEnergy[win];
+    }
+    if ( slotTimes.empty() )
+        return plan;
+
+    LevelTree tree(levels);
+    double slotEnergy = input.power * PLAN_SLOT / 3600;
+    std::vector<double> charged(slotTimes.size(), 0.0);
+    typedef std::pair<double, size_t> Candidate;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> cheapest;
+
+    size_t nextSlot = 0;
+    double stranded = 0.0;
+    for (size_t win = 0; win < input.windowEnds.size(); ++win){
+        if ( input.windowEnds[win] <= startTime )
+            continue;
+        for ( ; nextSlot < firstAfter[win]; ++nextSlot)
+            cheapest.push(Candidate(slotPrices[nextSlot], nextSlot));
+        // Trips before the first slot can only be checked
+        if ( firstAfter[win] == 0 ){
+            double deficit = input.tripEnergy[win] - departLevel[win] - stranded;
+            if ( deficit > 1e-9 ){
+                plan.shortfall += deficit;
+                stranded += deficit;
+                tree.add(0, slotTimes.size(), deficit);
+            }
+            continue;
+        }
+
+        // Level at the end of the last slot before leaving must cover the trip
+        size_t last = firstAfter[win] - 1;
+        double deficit = input.tripEnergy[win] - tree.get_max(last, last + 1);
+        while ( deficit > 1e-9 && !cheapest.empty() ){
+            size_t slot = cheapest.top().second;
+            double room = input.usable - tree.get_max(slot, slotTimes.size());
+            double amount = std::min(std::min(slotEnergy - charged[slot], deficit), room);
+            // Levels only rise so a slot that is full or capped stays that way
+            if ( amount <= 1e-9 ){
+                cheapest.pop();
+                continue;
+            }
+            tree.add(slot, slotTimes.size(), amount);
+            charged[slot] += amount;
+            plan.cost += amount * slotPrices[slot];
+            deficit -= amount;
+        }
+        if ( deficit > 1e-9 ){
+            // The bus strands here, later trips are planned as if it had made it
+            plan.shortfall += deficit;
+            if ( firstAfter[win] < slotTimes.size() )
+                tree.add(firstAfter[win], slotTimes.size(), deficit);
+        }
+    }
+
+    for (size_t slot = 0; slot < slotTimes.size(); ++slot){
+        if ( charged[slot] <= 0.0 )
+            continue;
+        plan.times.push_back(slotTimes[slot]);
+        plan.levels.push_back(tree.get_max(slot, slot + 1));
+    }
+
+    return plan;
+}
+
+} /** namespace */
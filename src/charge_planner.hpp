@@ -0,0 +1,42 @@
+#ifndef CHARGEPLANNER_H
+#define CHARGEPLANNER_H
+
+#include <vector>
+
+namespace BUS {
+
+#define PLAN_SLOT 60
+
+/** One bus's day for the planner, times in seconds and energy in kWh above min SoC */
+struct PlanInput {
+    std::vector<int> windowStarts;  /** Charge windows in order, window k ends at departure k */
+    std::vector<int> windowEnds;
+    std::vector<double> tripEnergy; /** Trip after each window */
+    double energy;                  /** Held at the start of the plan */
+    double usable;                  /** Pack between min and max SoC */
+    double power;                   /** kW at full charge rate */
+};
+
+/** Minutes a bus is planned to charge and the level it should reach by the end of each */
+struct ChargePlan {
+    std::vector<int> times;
+    std::vector<float> levels;
+    double cost = 0.0;
+    double shortfall = 0.0; /** kWh the windows could not deliver in time */
+
+    /** Level to reach by the end of the planned slot holding simTime, false if none is planned */
+    bool get_target(int simTime, double& level) const;
+};
+
+/**
+ * Cheapest charging for one bus against a price per PLAN_SLOT starting at startTime, the last
+ * price holds past the end. Departures are served in order, each from the cheapest slot before
+ * it that still has charge rate left and whose level stays under the usable pack for the rest of
+ * the day. A lazy segment tree keeps the levels so a slot is O(log n) and a bus O(n log n).
+ */
+ChargePlan plan_bus(PlanInput const& input, std::vector<double> const& prices, int startTime);
+
+}
+
+
+#endif /** CHARGEPLANNER_H */
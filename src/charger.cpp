@@ -1,12 +1,31 @@
 #include "charger.hpp"
+#include <limits>
 
 namespace BUS {
 
 Charger::Charger(int id, std::string name)
 :
     _id(id),
-    _name(name)
-{}
+    _name(name),
+    _powerCap(0.0),
+    _feederId(-1),
+    _demandThreshold(0.0),
+    _demandCharge(0.0),
+    _peakPower(0.0),
+    _connectTime(0),
+    _disconnectTime(0),
+    _plugEvents(60, 64),
+    _numConnects(0),
+    _maxWaiting(0),
+    _waitTime(0.0)
+{
+    for (int type = 0; type < NUM_PLUG_TYPES; ++type){
+        _hasPlugType[type]  = false;
+        _numPlugs[type]     = 0;
+        _plugsInUse[type]   = 0;
+        _maxPlugPower[type] = 0.0;
+    }
+}
 
 
 Charger::~Charger()
@@ -16,39 +35,351 @@ Charger::~Charger()
 void
 Charger::add_plugs(int numPlugs, PlugType plugType)
 {
-    auto it = _numPlugs.find(plugType);
-    if ( it == _numPlugs.end() ){
-        _numPlugs[plugType]      = numPlugs;
-        _numPlugsAvail[plugType] = numPlugs;
+    _hasPlugType[(int)plugType] = true;
+    _numPlugs[(int)plugType]   += numPlugs;
+    rebuild_plugs();
+
+    return;
+}
+
+
+void
+Charger::set_numPlugs(int numPlugs, PlugType plugType)
+{
+    _hasPlugType[(int)plugType] = true;
+    _numPlugs[(int)plugType]    = numPlugs;
+    rebuild_plugs();
+
+    return;
+}
+
+
+std::map<PlugType, int>
+Charger::get_numPlugs() const
+{
+    std::map<PlugType, int> numPlugs;
+    for (int type = 0; type < NUM_PLUG_TYPES; ++type){
+        if ( _hasPlugType[type] )
+            numPlugs[(PlugType)type] = _numPlugs[type];
     }
-    else {
-        _numPlugs[plugType]      += numPlugs;
-        _numPlugsAvail[plugType] += numPlugs;
+
+    return numPlugs;
+}
+
+
+bool
+Charger::acquire_plug(PlugType plugType)
+{
+    if ( _plugsInUse[(int)plugType] >= _numPlugs[(int)plugType] )
+        return false;
+
+    _plugsInUse[(int)plugType]++;
+    return true;
+}
+
+
+void
+Charger::release_plug(PlugType plugType)
+{
+    if ( _plugsInUse[(int)plugType] > 0 )
+        _plugsInUse[(int)plugType]--;
+}
+
+
+void
+Charger::release_all()
+{
+    // Scheduler state only exists when plugs were queued
+    if ( !_busPlugs.empty() || !_waiting.empty() || _plugEvents.size() > 0 )
+        rebuild_plugs();
+
+    for (int type = 0; type < NUM_PLUG_TYPES; ++type)
+        _plugsInUse[type] = 0;
+}
+
+
+void
+Charger::set_plugOverheads(int connectTime, int disconnectTime)
+{
+    _connectTime    = connectTime;
+    _disconnectTime = disconnectTime;
+}
+
+
+double
+Charger::get_plugPower(double power, PlugType plugType) const
+{
+    double maxPower = _maxPlugPower[(int)plugType];
+    if ( maxPower > 0.0 && power > maxPower )
+        return maxPower;
+    if ( maxPower > 0.0 && power < -maxPower )
+        return -maxPower;
+
+    return power;
+}
+
+
+void
+Charger::advance_plugs(int simTime)
+{
+    std::vector<int> due;
+    _plugEvents.pop_due(simTime, due);
+
+    for (auto& plugIdx: due){
+        Plug& plug = _plugs[plugIdx];
+        // Plug may have changed hands since the event was scheduled
+        if ( plug.readyTime > simTime )
+            continue;
+        if ( plug.state == PlugState::e_CONNECTING )
+            plug.state = PlugState::e_CONNECTED;
+        else if ( plug.state == PlugState::e_DISCONNECTING )
+            free_plug(plugIdx);
     }
+}
 
-    return;
+
+PlugStatus
+Charger::request_plug(int busId, PlugType plugType, int simTime)
+{
+    auto held = _busPlugs.find(busId);
+    if ( held != _busPlugs.end() ){
+        Plug& plug = _plugs[held->second];
+        plug.lastSeen = simTime;
+        return plug.state == PlugState::e_CONNECTED ? PlugStatus::e_CONNECTED : PlugStatus::e_CONNECTING;
+    }
+
+    std::vector<int>& freePlugs = _freePlugs[(int)plugType];
+    if ( freePlugs.empty() ){
+        _waiting[busId] = simTime;
+        return PlugStatus::e_QUEUED;
+    }
+
+    int plugIdx = freePlugs.back();
+    freePlugs.pop_back();
+    _waiting.erase(busId);
+    _busPlugs[busId] = plugIdx;
+    _plugsInUse[(int)plugType]++;
+    _numConnects++;
+
+    Plug& plug = _plugs[plugIdx];
+    plug.busId     = busId;
+    plug.lastSeen  = simTime;
+    plug.readyTime = simTime + _connectTime;
+    if ( _connectTime <= 0 ){
+        plug.state = PlugState::e_CONNECTED;
+        return PlugStatus::e_CONNECTED;
+    }
+
+    plug.state = PlugState::e_CONNECTING;
+    _plugEvents.schedule(plug.readyTime, plugIdx);
+
+    return PlugStatus::e_CONNECTING;
 }
 
 
-int
-Charger::get_numPlugs(PlugType plugType) const 
+void
+Charger::keep_plug(int busId, int simTime)
 {
-    auto it = _numPlugs.find(plugType);
-    if ( it == _numPlugs.end() )
-        return -1; // Could not find this plugType at this charger
-    
-    return it->second;
+    auto held = _busPlugs.find(busId);
+    if ( held != _busPlugs.end() )
+        _plugs[held->second].lastSeen = simTime;
+}
+
+
+void
+Charger::end_step(int simTime, int timestep)
+{
+    for (auto it = _busPlugs.begin(); it != _busPlugs.end(); ){
+        Plug& plug = _plugs[it->second];
+        if ( plug.lastSeen == simTime ){
+            ++it;
+            continue;
+        }
+
+        if ( _disconnectTime <= 0 )
+            free_plug(it->second);
+        else {
+            plug.state     = PlugState::e_DISCONNECTING;
+            plug.readyTime = simTime + _disconnectTime;
+            _plugEvents.schedule(plug.readyTime, it->second);
+        }
+        it = _busPlugs.erase(it);
+    }
+
+    // Buses that left without a plug stop waiting, the rest waited the whole step
+    for (auto it = _waiting.begin(); it != _waiting.end(); ){
+        if ( it->second != simTime )
+            it = _waiting.erase(it);
+        else {
+            _waitTime += timestep;
+            ++it;
+        }
+    }
+    if ( (int)_waiting.size() > _maxWaiting )
+        _maxWaiting = _waiting.size();
 }
 
 
 int
-Charger::get_numPlugsAvail(PlugType plugType) const 
+Charger::get_nextPlugEvent() const
+{
+    int nextEvent = std::numeric_limits<int>::max();
+    if ( _plugEvents.size() == 0 )
+        return nextEvent;
+
+    for (auto& plug: _plugs){
+        bool pending = (plug.state == PlugState::e_CONNECTING || plug.state == PlugState::e_DISCONNECTING);
+        if ( pending && plug.readyTime < nextEvent )
+            nextEvent = plug.readyTime;
+    }
+
+    return nextEvent;
+}
+
+
+void
+Charger::rebuild_plugs()
+{
+    // Plug counts changed so buses holding a scheduled plug reconnect at their next request
+    for (auto& plug: _plugs){
+        if ( plug.state != PlugState::e_FREE )
+            _plugsInUse[(int)plug.type]--;
+    }
+    _plugs.clear();
+    _busPlugs.clear();
+    _waiting.clear();
+    _plugEvents.clear();
+    for (int type = 0; type < NUM_PLUG_TYPES; ++type){
+        _freePlugs[type].clear();
+        for (int idx = 0; idx < _numPlugs[type]; ++idx){
+            Plug plug = {(PlugType)type, PlugState::e_FREE, -1, 0, 0};
+            _plugs.push_back(plug);
+        }
+    }
+
+    // Stack is filled back to front so the lowest index plug is handed out first
+    for (int plugIdx = _plugs.size() - 1; plugIdx >= 0; --plugIdx)
+        _freePlugs[(int)_plugs[plugIdx].type].push_back(plugIdx);
+}
+
+
+void
+Charger::free_plug(int plugIdx)
 {
-    auto it = _numPlugsAvail.find(plugType);
-    if ( it == _numPlugsAvail.end() )
-        return -1; // Could not find this plugType at this charger
-    
-    return it->second;
+    Plug& plug = _plugs[plugIdx];
+    plug.state = PlugState::e_FREE;
+    plug.busId = -1;
+    _freePlugs[(int)plug.type].push_back(plugIdx);
+    _plugsInUse[(int)plug.type]--;
+}
+
+
+void
+Charger::save_state(CKPT::Writer& out) const
+{
+    out.put(_id);
+    for (int type = 0; type < NUM_PLUG_TYPES; ++type){
+        out.put<uint8_t>(_hasPlugType[type]);
+        out.put<int32_t>(_numPlugs[type]);
+        out.put<int32_t>(_plugsInUse[type]);
+        out.put(_maxPlugPower[type]);
+    }
+    out.put(_powerCap);
+    out.put(_feederId);
+    out.put(_demandThreshold);
+    out.put(_demandCharge);
+    out.put(_peakPower);
+    out.put(_connectTime);
+    out.put(_disconnectTime);
+    out.put(_numConnects);
+    out.put(_maxWaiting);
+    out.put(_waitTime);
+
+    // Free stacks and the event wheel are rebuilt from the plugs on restore
+    out.put<uint32_t>(_plugs.size());
+    for (auto& plug: _plugs){
+        out.put<int32_t>((int)plug.type);
+        out.put<uint8_t>((uint8_t)plug.state);
+        out.put<int32_t>(plug.busId);
+        out.put<int32_t>(plug.readyTime);
+        out.put<int32_t>(plug.lastSeen);
+    }
+    out.put<uint32_t>(_waiting.size());
+    for (auto& waiting: _waiting){
+        out.put<int32_t>(waiting.first);
+        out.put<int32_t>(waiting.second);
+    }
+}
+
+
+bool
+Charger::restore_state(CKPT::Reader& in)
+{
+    in.expect(_id);
+    for (int type = 0; type < NUM_PLUG_TYPES; ++type){
+        uint8_t hasPlugType = 0;
+        int32_t numPlugs = 0, inUse = 0;
+        in.get(hasPlugType);
+        in.get(numPlugs);
+        in.get(inUse);
+        in.get(_maxPlugPower[type]);
+        _hasPlugType[type] = hasPlugType;
+        _numPlugs[type]    = numPlugs;
+        _plugsInUse[type]  = inUse;
+    }
+    in.get(_powerCap);
+    in.get(_feederId);
+    in.get(_demandThreshold);
+    in.get(_demandCharge);
+    in.get(_peakPower);
+    in.get(_connectTime);
+    in.get(_disconnectTime);
+    in.get(_numConnects);
+    in.get(_maxWaiting);
+    in.get(_waitTime);
+
+    uint32_t numPlugs = 0;
+    in.get(numPlugs);
+    _plugs.clear();
+    for (uint32_t idx = 0; idx < numPlugs && in.good(); ++idx){
+        int32_t type = 0, busId = 0, readyTime = 0, lastSeen = 0;
+        uint8_t state = 0;
+        in.get(type);
+        in.get(state);
+        in.get(busId);
+        in.get(readyTime);
+        in.get(lastSeen);
+        if ( state > (uint8_t)PlugState::e_DISCONNECTING )
+            return false;
+        _plugs.push_back(Plug{(PlugType)type, (PlugState)state, busId, readyTime, lastSeen});
+    }
+    uint32_t numWaiting = 0;
+    in.get(numWaiting);
+    _waiting.clear();
+    for (uint32_t idx = 0; idx < numWaiting && in.good(); ++idx){
+        int32_t busId = 0, lastSeen = 0;
+        in.get(busId);
+        in.get(lastSeen);
+        _waiting[busId] = lastSeen;
+    }
+
+    _busPlugs.clear();
+    _plugEvents.clear();
+    for (int type = 0; type < NUM_PLUG_TYPES; ++type)
+        _freePlugs[type].clear();
+    for (int plugIdx = _plugs.size() - 1; plugIdx >= 0; --plugIdx){
+        Plug const& plug = _plugs[plugIdx];
+        if ( (int)plug.type < 0 || (int)plug.type >= NUM_PLUG_TYPES )
+            return false;
+        if ( plug.state == PlugState::e_FREE )
+            _freePlugs[(int)plug.type].push_back(plugIdx);
+        if ( plug.state == PlugState::e_CONNECTING || plug.state == PlugState::e_CONNECTED )
+            _busPlugs[plug.busId] = plugIdx;
+        if ( plug.state == PlugState::e_CONNECTING || plug.state == PlugState::e_DISCONNECTING )
+            _plugEvents.schedule(plug.readyTime, plugIdx);
+    }
+
+    return in.good();
 }
 
 
@@ -1,8 +1,12 @@
 #ifndef CHARGER_H
 #define CHARGER_H
 
+#include <algorithm>
 #include <string>
 #include <map>
+#include <vector>
+#include "checkpoint.hpp"
+#include "timing_wheel.hpp"
 
 namespace BUS {
 
@@ -11,6 +15,8 @@ enum class PlugType {
     EVA080K  = 1
 };
 
+#define NUM_PLUG_TYPES 2
+
 static std::map<std::string, PlugType> plugNameToType = {
     {"SAEJ3105",    PlugType::SAEJ3105 },
     {"EVA080K",     PlugType::EVA080K  }
@@ -21,28 +27,122 @@ static std::map<PlugType, std::string> plugTypeToName = {
     {PlugType::EVA080K,     "EVA080K"  }
 };
 
-class Charger 
+/** Where a bus stands with the plug scheduler, only connected buses draw power */
+enum class PlugStatus {
+    e_QUEUED     = 0,
+    e_CONNECTING = 1,
+    e_CONNECTED  = 2
+};
+
+class Charger
 {
 public:
     Charger(int id, std::string name);
     ~Charger();
 
     void add_plugs(int numPlugs, PlugType plugType);
-    
+    void set_numPlugs(int numPlugs, PlugType plugType);
+
     int get_identifier() const {return _id;}
     std::string get_name() const {return _name;}
-    std::map<PlugType, int> get_numPlugs() const {return _numPlugs;}
-    int get_numPlugs(PlugType plugType) const;
-    int get_numPlugsAvail(PlugType plugType) const;
+    std::map<PlugType, int> get_numPlugs() const;
+    bool has_plugType(PlugType plugType) const {return _hasPlugType[(int)plugType];}
+    int get_numPlugs(PlugType plugType) const {return _numPlugs[(int)plugType];}
+    int get_numPlugsInUse(PlugType plugType) const {return _plugsInUse[(int)plugType];}
+    int get_numPlugsAvail(PlugType plugType) const {return _numPlugs[(int)plugType] - _plugsInUse[(int)plugType];}
+
+    /** Live occupancy, a bus holds a plug from acquire until release or the next release_all */
+    bool acquire_plug(PlugType plugType);
+    void release_plug(PlugType plugType);
+    void release_all();
+
+    /**
+     * Plug scheduler, used instead of acquire/release when plugs are queued. A bus keeps its plug
+     * across steps while it asks for it, connecting and disconnecting take the overhead in seconds
+     * during which the plug is busy but delivers no power. Buses without a free plug wait in queue.
+     */
+    void set_plugOverheads(int connectTime, int disconnectTime);
+    void set_maxPlugPower(double maxPower, PlugType plugType) {_maxPlugPower[(int)plugType] = maxPower;}
+    double get_plugPower(double power, PlugType plugType) const;
+
+    /** Site limit in kW on the total drawn by every plug, zero leaves the site uncapped */
+    void set_powerCap(double maxPower) {_powerCap = maxPower;}
+    double get_powerCap() const {return _powerCap;}
+    /** Feeder the site hangs off, chargers on one feeder share its cap, -1 for none */
+    void set_feeder(int feederId) {_feederId = feederId;}
+    int get_feeder() const {return _feederId;}
+    /** Demand charge in $/kW on the site peak above threshold kW, zero leaves the site without one */
+    void set_demandCharge(double threshold, double charge) {_demandThreshold = threshold; _demandCharge = charge;}
+    double get_demandThreshold() const {return _demandThreshold;}
+    double get_demandCharge() const {return _demandCharge;}
+    /** Highest site power seen this run, kW */
+    void record_power(double power) {_peakPower = std::max(_peakPower, power);}
+    double get_peakPower() const {return _peakPower;}
+
+    /** Completes connects and disconnects due by simTime, call once before the step's requests */
+    void advance_plugs(int simTime);
+    PlugStatus request_plug(int busId, PlugType plugType, int simTime);
+    /** Keeps the plug of a bus that is still at the charger but did not draw power this step */
+    void keep_plug(int busId, int simTime);
+    /** Disconnects buses that did not ask for their plug this step and drops them from the queue */
+    void end_step(int simTime, int timestep);
+    /** Earliest pending connect or disconnect, INT_MAX when there is none */
+    int get_nextPlugEvent() const;
+
+    int get_numConnects() const {return _numConnects;}
+    int get_numWaiting() const {return _waiting.size();}
+    int get_maxWaiting() const {return _maxWaiting;}
+    double get_waitTime() const {return _waitTime;}
+
+    /** Plug counts, occupancy and scheduler state, restore into a charger with the same id */
+    void save_state(CKPT::Writer& out) const;
+    bool restore_state(CKPT::Reader& in);
 
 private:
+    enum class PlugState : uint8_t {
+        e_FREE          = 0,
+        e_CONNECTING    = 1,
+        e_CONNECTED     = 2,
+        e_DISCONNECTING = 3
+    };
+
+    struct Plug {
+        PlugType  type;
+        PlugState state;
+        int       busId;
+        int       readyTime; /** When connecting or disconnecting finishes */
+        int       lastSeen;  /** Last step the bus asked for this plug */
+    };
+
     int _id;
     std::string _name;
-    std::map<PlugType, int> _numPlugs;
-    std::map<PlugType, int> _numPlugsAvail;
+    bool _hasPlugType[NUM_PLUG_TYPES];
+    int _numPlugs[NUM_PLUG_TYPES];
+    int _plugsInUse[NUM_PLUG_TYPES];
+    double _maxPlugPower[NUM_PLUG_TYPES]; /** kW, zero leaves the bus charge rate as the limit */
+    double _powerCap;
+    int _feederId;
+    double _demandThreshold;
+    double _demandCharge;
+    double _peakPower;
+
+    int _connectTime;
+    int _disconnectTime;
+    std::vector<Plug> _plugs;
+    std::vector<int> _freePlugs[NUM_PLUG_TYPES]; /** Indexes into _plugs used as a stack */
+    std::map<int, int> _busPlugs;                /** Plug index held by each bus id */
+    std::map<int, int> _waiting;                 /** Bus ids waiting for a plug and the last step they asked */
+    TimingWheel<int> _plugEvents;
+
+    int _numConnects;
+    int _maxWaiting;
+    double _waitTime; /** Bus seconds spent waiting for a plug */
+
+    void rebuild_plugs();
+    void free_plug(int plugIdx);
 };
 
 }
 
 
-#endif /** CHARGER_H */
\ No newline at end of file
+#endif /** CHARGER_H */
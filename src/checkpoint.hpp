@@ -0,0 +1,120 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+
+/**
+ * Flat binary blobs for checkpointing manager state. Values are written in native byte order,
+ * a blob is only meant to be restored on the machine and build that wrote it.
+ *
+ * Blob format: 8 byte magic, uint32 version, then the fields the owner writes in order
+ */
+namespace CKPT {
+
+#define CHECKPOINT_VERSION 16
+
+class Writer
+{
+public:
+    explicit Writer(char const* magic) {
+        _blob.append(magic, 8);
+        put<uint32_t>(CHECKPOINT_VERSION);
+    }
+
+    template <typename T>
+    void put(T const& value) {
+        _blob.append(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void put_vector(std::vector<T> const& values) {
+        put<uint32_t>(values.size());
+        if ( !values.empty() )
+            _blob.append(reinterpret_cast<char const*>(&values[0]), sizeof(T) * values.size());
+    }
+
+    void put_string(std::string const& value) {
+        put<uint32_t>(value.size());
+        _blob.append(value);
+    }
+
+    std::string const& get_blob() const {return _blob;}
+
+private:
+    std::string _blob;
+};
+
+
+/** Reads stop at the end of the blob, check ok() once everything has been read */
+class Reader
+{
+public:
+    Reader(char const* data, size_t size, char const* magic)
+    :
+        _data(data),
+        _size(size),
+        _pos(0),
+        _ok(size >= 12 && std::memcmp(data, magic, 8) == 0)
+    {
+        _pos = 8;
+        uint32_t version = 0;
+        get(version);
+        _ok = _ok && version == CHECKPOINT_VERSION;
+    }
+
+    template <typename T>
+    bool get(T& value) {
+        if ( !_ok || _size - _pos < sizeof(T) )
+            return (_ok = false);
+        std::memcpy(&value, _data + _pos, sizeof(T));
+        _pos += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool get_vector(std::vector<T>& values) {
+        uint32_t count = 0;
+        if ( !get(count) || (_size - _pos) / sizeof(T) < count )
+            return (_ok = false);
+        values.resize(count);
+        if ( count > 0 )
+            std::memcpy(&values[0], _data + _pos, sizeof(T) * count);
+        _pos += sizeof(T) * count;
+        return true;
+    }
+
+    bool get_string(std::string& value) {
+        uint32_t length = 0;
+        if ( !get(length) || _size - _pos < length )
+            return (_ok = false);
+        value.assign(_data + _pos, length);
+        _pos += length;
+        return true;
+    }
+
+    /** A value that must match the restoring object, such as a count or an identifier */
+    template <typename T>
+    bool expect(T const& expected) {
+        T value;
+        if ( get(value) && !(value == expected) )
+            _ok = false;
+        return _ok;
+    }
+
+    bool ok() const {return _ok && _pos == _size;}
+    bool good() const {return _ok;}
+
+private:
+    char const* _data;
+    size_t      _size;
+    size_t      _pos;
+    bool        _ok;
+};
+
+} // namespace CKPT
+
+
+#endif /** CHECKPOINT_H */
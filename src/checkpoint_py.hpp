@@ -0,0 +1,31 @@
+#ifndef CHECKPOINTPY_H
+#define CHECKPOINTPY_H
+
+#include "checkpoint.hpp"
+#include <boost/python.hpp>
+
+namespace CKPT {
+
+/** Blobs cross into python as bytes (str on python 2) */
+inline boost::python::object
+blob_toBytes(std::string const& blob)
+{
+    return boost::python::object(boost::python::handle<>(PyBytes_FromStringAndSize(blob.data(), blob.size())));
+}
+
+
+inline std::string
+bytes_toBlob(boost::python::object const& bytes)
+{
+    char* data = nullptr;
+    Py_ssize_t size = 0;
+    if ( PyBytes_AsStringAndSize(bytes.ptr(), &data, &size) != 0 )
+        boost::python::throw_error_already_set();
+
+    return std::string(data, size);
+}
+
+} // namespace CKPT
+
+
+#endif /** CHECKPOINTPY_H */
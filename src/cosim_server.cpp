@@ -0,0 +1,279 @@
+#include "cosim_server.hpp"
+#include "bus_manager.hpp"
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+#define LOGERR(fmt, args...)   do{ fprintf(stderr, fmt "\n", ##args); }while(0)
+
+#define COSIM_HEADER_LEN    8
+#define COSIM_MAX_PAYLOAD   (1 << 20)
+
+
+namespace BUS {
+
+namespace {
+
+// Host is assumed little endian, matching the wire format
+template< typename T >
+void put(std::vector<uint8_t>& buf, T value)
+{
+    uint8_t bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    buf.insert(buf.end(), bytes, bytes + sizeof(T));
+}
+
+template< typename T >
+T get(uint8_t const* data)
+{
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+}
+
+
+CosimServer::CosimServer(BusManager& busManager, int mode, int maxStepsPerPoll)
+:
+    _busManager(busManager),
+    _mode(mode),
+    _maxStepsPerPoll(maxStepsPerPoll > 0 ? maxStepsPerPoll : 1),
+    _listenFd(-1),
+    _clientFd(-1),
+    _nextStepTime(16200),
+    _targetTime(0),
+    _powerRequest(0.0),
+    _statePending(false),
+    _stop(false)
+{}
+
+
+CosimServer::~CosimServer()
+{
+    close_client();
+    if ( _listenFd >= 0 )
+        close(_listenFd);
+}
+
+
+int
+CosimServer::serve(std::string const& socketPath)
+{
+    struct sockaddr_un addr;
+    if ( socketPath.size() >= sizeof(addr.sun_path) ){
+        LOGERR("Socket path too long: %s", socketPath.c_str());
+        return -1;
+    }
+
+    _listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( _listenFd < 0 ){
+        LOGERR("Could not create socket: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socketPath.c_str());
+    if ( bind(_listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(_listenFd, 1) < 0 ){
+        LOGERR("Could not listen on %s: %s", socketPath.c_str(), strerror(errno));
+        return -1;
+    }
+
+    while ( !_stop ){
+        if ( _clientFd < 0 ){
+            _clientFd = accept(_listenFd, NULL, NULL);
+            if ( _clientFd < 0 ){
+                if ( errno == EINTR )
+                    continue;
+                LOGERR("Accept failed: %s", strerror(errno));
+                break;
+            }
+            _rxBuffer.clear();
+        }
+
+        // Only block on the socket once the simulation has caught up with the latest setpoint
+        bool behind = _nextStepTime <= _targetTime;
+        struct pollfd pfd = { _clientFd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, behind ? 0 : -1);
+        if ( ready < 0 && errno != EINTR ){
+            LOGERR("Poll failed: %s", strerror(errno));
+            break;
+        }
+        if ( ready > 0 && read_messages() != 0 ){
+            close_client();
+            continue;
+        }
+
+        step_toTarget();
+
+        if ( _statePending && _nextStepTime > _targetTime ){
+            if ( publish_state() != 0 )
+                close_client();
+            _statePending = false;
+        }
+    }
+
+    close_client();
+    close(_listenFd);
+    _listenFd = -1;
+    unlink(socketPath.c_str());
+
+    return 0;
+}
+
+
+int
+CosimServer::read_messages()
+{
+    // Drain everything that has queued up so it can be handled as one batch
+    uint8_t chunk[4096];
+    while ( true ){
+        ssize_t len = recv(_clientFd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if ( len > 0 ){
+            _rxBuffer.insert(_rxBuffer.end(), chunk, chunk + len);
+            continue;
+        }
+        if ( len == 0 )
+            return -1; // Client closed the connection
+        if ( errno == EAGAIN || errno == EWOULDBLOCK )
+            break;
+        if ( errno != EINTR )
+            return -1;
+    }
+
+    size_t offset = 0;
+    while ( _rxBuffer.size() - offset >= COSIM_HEADER_LEN ){
+        uint8_t  type   = _rxBuffer[offset];
+        uint32_t length = get<uint32_t>(&_rxBuffer[offset + 4]);
+        if ( length > COSIM_MAX_PAYLOAD )
+            return -1;
+        if ( _rxBuffer.size() - offset < COSIM_HEADER_LEN + length )
+            break;
+
+        handle_message(type, &_rxBuffer[offset + COSIM_HEADER_LEN], length);
+        offset += COSIM_HEADER_LEN + length;
+    }
+    _rxBuffer.erase(_rxBuffer.begin(), _rxBuffer.begin() + offset);
+
+    return 0;
+}
+
+
+void
+CosimServer::handle_message(uint8_t type, uint8_t const* payload, uint32_t length)
+{
+    switch( type ){
+    case eCOSIM_SETPOINT:
+        if ( length < 12 )
+            break;
+        _targetTime   = std::max(_targetTime, get<int32_t>(payload));
+        _powerRequest = get<double>(payload + 4);
+        _statePending = true;
+        return;
+    case eCOSIM_TELEMETRY:
+        _statePending = true;
+        return;
+    case eCOSIM_SHUTDOWN:
+        _stop = true;
+        return;
+    default:
+        break;
+    }
+
+    _txBuffer.clear();
+    put<uint8_t>(_txBuffer, type);
+    send_message(eCOSIM_ERROR);
+}
+
+
+void
+CosimServer::step_toTarget()
+{
+    int timestep = _busManager.get_timestep();
+    for (int step = 0; step < _maxStepsPerPoll && _nextStepTime <= _targetTime; ++step){
+        _busManager.run(_powerRequest, _mode, _nextStepTime);
+        _nextStepTime += timestep;
+    }
+}
+
+
+int
+CosimServer::publish_state()
+{
+    int simTime = _busManager.get_lastSimTime();
+    int timestep = _busManager.get_timestep();
+
+    _txBuffer.clear();
+    put<int32_t>(_txBuffer, simTime);
+    put<double>(_txBuffer, _busManager.get_lastPwrConsump());
+
+    auto& chargers = _busManager.get_chargers();
+    put<uint32_t>(_txBuffer, chargers.size());
+    for (auto& chrgr: chargers){
+        uint8_t numPlugTypes = 0;
+        for (int type = 0; type < NUM_PLUG_TYPES; ++type)
+            numPlugTypes += chrgr.second->has_plugType((PlugType)type);
+
+        put<int32_t>(_txBuffer, chrgr.first);
+        put<uint8_t>(_txBuffer, numPlugTypes);
+        for (int type = 0; type < NUM_PLUG_TYPES; ++type){
+            if ( !chrgr.second->has_plugType((PlugType)type) )
+                continue;
+            put<uint8_t>(_txBuffer, (uint8_t)type);
+            put<uint16_t>(_txBuffer, chrgr.second->get_numPlugsInUse((PlugType)type));
+        }
+    }
+
+    auto& buses = _busManager.get_buses();
+    put<uint32_t>(_txBuffer, buses.size());
+    for (auto& bus: buses){
+        put<int32_t>(_txBuffer, bus.first);
+        put<float>(_txBuffer, bus.second->get_currentSoc(simTime, timestep));
+        put<float>(_txBuffer, bus.second->get_currentPower(simTime));
+    }
+
+    return send_message(eCOSIM_STATE);
+}
+
+
+int
+CosimServer::send_message(uint8_t type)
+{
+    std::vector<uint8_t> header;
+    put<uint8_t>(header, type);
+    put<uint8_t>(header, 0);
+    put<uint16_t>(header, 0);
+    put<uint32_t>(header, _txBuffer.size());
+    _txBuffer.insert(_txBuffer.begin(), header.begin(), header.end());
+
+    size_t sent = 0;
+    while ( sent < _txBuffer.size() ){
+        ssize_t len = send(_clientFd, &_txBuffer[sent], _txBuffer.size() - sent, MSG_NOSIGNAL);
+        if ( len < 0 ){
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        sent += len;
+    }
+
+    return 0;
+}
+
+
+void
+CosimServer::close_client()
+{
+    if ( _clientFd >= 0 )
+        close(_clientFd);
+    _clientFd = -1;
+}
+
+
+} /** namespace */
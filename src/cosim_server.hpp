@@ -0,0 +1,75 @@
+#ifndef COSIMSERVER_H
+#define COSIMSERVER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace BUS {
+
+class BusManager; // Forward declaration
+
+/** Message types, replies from the server have the top bit set */
+enum CosimMsgType {
+    eCOSIM_SETPOINT  = 0x01,
+    eCOSIM_TELEMETRY = 0x02,
+    eCOSIM_SHUTDOWN  = 0x03,
+    eCOSIM_STATE     = 0x81,
+    eCOSIM_ERROR     = 0xFF
+};
+
+/** 
+ * Wire format over a SOCK_STREAM unix socket, all fields little endian
+ *
+ *  Header    : uint8 type, uint8 reserved[3], uint32 payload length
+ *  SETPOINT  : int32 simTime, float64 powerRequest (kW)
+ *  TELEMETRY : empty, answered with STATE at the current sim time
+ *  SHUTDOWN  : empty, server closes the socket and serve returns
+ *  STATE     : int32 simTime, float64 powerConsumption (kW),
+ *              uint32 numChargers, numChargers x { int32 chargerId, uint8 numPlugTypes,
+ *                                                  numPlugTypes x { uint8 plugType, uint16 plugsInUse } },
+ *              uint32 numBuses, numBuses x { int32 busId, float32 soc, float32 power (kW) }
+ *  ERROR     : uint8 message type that could not be handled
+ *
+ * Setpoints that queue up while the simulation is stepping are batched: the latest power request
+ * is used for every step and a single STATE is published once the latest setpoint time is reached.
+ */
+class CosimServer
+{
+public:
+    CosimServer(BusManager& busManager, int mode, int maxStepsPerPoll);
+    ~CosimServer();
+
+    /** Blocks serving one client at a time until a SHUTDOWN message is received */
+    int serve(std::string const& socketPath);
+
+private:
+    BusManager& _busManager;
+    int _mode;
+    int _maxStepsPerPoll;   /** Steps taken before checking the socket again */
+
+    int _listenFd;
+    int _clientFd;
+    std::vector<uint8_t> _rxBuffer;
+    std::vector<uint8_t> _txBuffer;
+
+    int    _nextStepTime;
+    int    _targetTime;
+    double _powerRequest;
+    bool   _statePending;
+    bool   _stop;
+
+    CosimServer(const CosimServer&) = delete;
+
+    int  read_messages();
+    void handle_message(uint8_t type, uint8_t const* payload, uint32_t length);
+    void step_toTarget();
+    int  publish_state();
+    int  send_message(uint8_t type);
+    void close_client();
+};
+
+}
+
+
+#endif /** COSIMSERVER_H */
@@ -0,0 +1,151 @@
+#include "emissions_ledger.hpp"
+
+namespace NRG {
+
+EmissionsLedger::EmissionsLedger()
+{
+    reset(0);
+}
+
+
+void
+EmissionsLedger::reset(size_t numPlants)
+{
+    _numPlants = numPlants;
+    _times.clear();
+    _carbonDioxide.clear();
+    _methane.clear();
+    _nitrousOxide.clear();
+    _marginal.clear();
+    _busPower.clear();
+    _days.clear();
+    _dailyTotals.clear();
+    _busEmissions = {0.0, 0.0, 0.0};
+    _busEnergy    = 0.0;
+}
+
+
+void
+EmissionsLedger::reserve(size_t numSteps)
+{
+    _times.reserve(numSteps);
+    _carbonDioxide.reserve(numSteps * _numPlants);
+    _methane.reserve(numSteps * _numPlants);
+    _nitrousOxide.reserve(numSteps * _numPlants);
+    _marginal.reserve(numSteps);
+    _busPower.reserve(numSteps);
+}
+
+
+void
+EmissionsLedger::record(int simTime, int stepSeconds, double const* power, Emissions const* rates,
+                        Emissions const& marginal, double busPower)
+{
+    double stepHours = stepSeconds / 3600.0;
+    Emissions stepTotal = {0.0, 0.0, 0.0};
+    for (size_t plant = 0; plant < _numPlants; ++plant){
+        Emissions emitted = rates[plant] * (power[plant] * stepHours);
+        _carbonDioxide.push_back(emitted.carbonDioxide);
+        _methane.push_back(emitted.methane);
+        _nitrousOxide.push_back(emitted.nitrousOxide);
+        stepTotal += emitted;
+    }
+    _times.push_back(simTime);
+    _marginal.push_back(marginal);
+    _busPower.push_back(busPower);
+
+    int day = simTime / SECONDS_PER_DAY;
+    if ( _days.empty() || _days.back() != day ){
+        _days.push_back(day);
+        _dailyTotals.push_back({0.0, 0.0, 0.0});
+    }
+    _dailyTotals.back() += stepTotal;
+
+    // Discharging back to the grid is credited at the same marginal rate
+    double busEnergy = busPower * stepHours;
+    _busEnergy    += busEnergy;
+    _busEmissions += marginal * busEnergy;
+}
+
+
+Emissions
+EmissionsLedger::get_step(size_t step) const
+{
+    Emissions total = {0.0, 0.0, 0.0};
+    for (size_t idx = step * _numPlants; idx < (step + 1) * _numPlants; ++idx)
+        total += {_carbonDioxide[idx], _methane[idx], _nitrousOxide[idx]};
+
+    return total;
+}
+
+
+Emissions
+EmissionsLedger::get_total() const
+{
+    Emissions total = {0.0, 0.0, 0.0};
+    for (auto const& daily: _dailyTotals)
+        total += daily;
+
+    return total;
+}
+
+
+Emissions
+EmissionsLedger::get_busMarginal() const
+{
+    if ( _busEnergy <= 0.0 )
+        return {0.0, 0.0, 0.0};
+
+    return _busEmissions * (1.0 / _busEnergy);
+}
+
+
+void
+EmissionsLedger::save_state(CKPT::Writer& out) const
+{
+    // Totals are written rather than rebuilt so a restore does not depend on step sizes
+    out.put<uint32_t>(_numPlants);
+    out.put_vector(_times);
+    out.put_vector(_carbonDioxide);
+    out.put_vector(_methane);
+    out.put_vector(_nitrousOxide);
+    out.put_vector(_marginal);
+    out.put_vector(_busPower);
+    out.put_vector(_days);
+    out.put_vector(_dailyTotals);
+    out.put(_busEmissions);
+    out.put(_busEnergy);
+}
+
+
+bool
+EmissionsLedger::restore_state(CKPT::Reader& in)
+{
+    EmissionsLedger ledger;
+    uint32_t numPlants = 0;
+    in.get(numPlants);
+    in.get_vector(ledger._times);
+    in.get_vector(ledger._carbonDioxide);
+    in.get_vector(ledger._methane);
+    in.get_vector(ledger._nitrousOxide);
+    in.get_vector(ledger._marginal);
+    in.get_vector(ledger._busPower);
+    in.get_vector(ledger._days);
+    in.get_vector(ledger._dailyTotals);
+    in.get(ledger._busEmissions);
+    in.get(ledger._busEnergy);
+
+    size_t numValues = ledger._times.size() * numPlants;
+    if ( !in.good() || numPlants != _numPlants ||
+         ledger._carbonDioxide.size() != numValues || ledger._methane.size() != numValues ||
+         ledger._nitrousOxide.size() != numValues || ledger._marginal.size() != ledger._times.size() ||
+         ledger._busPower.size() != ledger._times.size() || ledger._days.size() != ledger._dailyTotals.size() )
+        return false;
+
+    ledger._numPlants = numPlants;
+    *this = std::move(ledger);
+
+    return true;
+}
+
+} // namespace NRG
@@ -0,0 +1,81 @@
+#ifndef EMISSIONSLEDGER_H
+#define EMISSIONSLEDGER_H
+
+#include "plant_table.hpp"
+#include "checkpoint.hpp"
+#include <vector>
+#include <stdint.h>
+
+namespace NRG {
+
+#define SECONDS_PER_DAY 86400
+
+/**
+ * Emissions integrated over every dispatch step. Each gas is a column of step major values with
+ * one entry per plant in source order, so a step is a contiguous row and a plant a strided column.
+ * Daily and bus charging totals are kept running so reading them does not rescan the series.
+ *
+ * Bus charging is charged at the rate of the marginal plant, the one that would have picked up
+ * another MW of demand at that step, since that is what the buses actually add to the grid.
+ */
+class EmissionsLedger
+{
+public:
+    EmissionsLedger();
+
+    /** Clears the series, a step holds numPlants values per gas */
+    void reset(size_t numPlants);
+    /** Room for numSteps steps so recording does not allocate */
+    void reserve(size_t numSteps);
+
+    /**
+     * Appends the step starting at simTime. power is MW per plant held for stepSeconds, rates
+     * are per MWh for each plant, marginal is the marginal plant's rate and busPower the MW of
+     * the demand that was bus charging.
+     */
+    void record(int simTime, int stepSeconds, double const* power, Emissions const* rates,
+                Emissions const& marginal, double busPower);
+
+    size_t get_numPlants() const {return _numPlants;}
+    size_t get_numSteps() const {return _times.size();}
+    std::vector<int32_t> const& get_times() const {return _times;}
+    std::vector<double> const& get_carbonDioxide() const {return _carbonDioxide;}
+    std::vector<double> const& get_methane() const {return _methane;}
+    std::vector<double> const& get_nitrousOxide() const {return _nitrousOxide;}
+    std::vector<Emissions> const& get_marginalRates() const {return _marginal;}
+
+    Emissions get_step(size_t step) const;
+    Emissions get_total() const;
+
+    /** Day since the start of sim time and its total, one entry per day with a recorded step */
+    std::vector<int32_t> const& get_days() const {return _days;}
+    std::vector<Emissions> const& get_dailyTotals() const {return _dailyTotals;}
+
+    /** MWh of bus charging and what it emitted at the marginal rates */
+    double get_busEnergy() const {return _busEnergy;}
+    Emissions get_busEmissions() const {return _busEmissions;}
+    /** Per MWh of bus charging, zero before any charging */
+    Emissions get_busMarginal() const;
+
+    /** Restoring reads into temporaries, the ledger is left untouched unless the blob checks out */
+    void save_state(CKPT::Writer& out) const;
+    bool restore_state(CKPT::Reader& in);
+
+private:
+    size_t _numPlants;
+    std::vector<int32_t>   _times;
+    std::vector<double>    _carbonDioxide;
+    std::vector<double>    _methane;
+    std::vector<double>    _nitrousOxide;
+    std::vector<Emissions> _marginal;      /** Marginal plant's rate per step */
+    std::vector<double>    _busPower;      /** MW of bus charging per step    */
+    std::vector<int32_t>   _days;
+    std::vector<Emissions> _dailyTotals;
+    Emissions              _busEmissions;
+    double                 _busEnergy;
+};
+
+} // namespace NRG
+
+
+#endif /** EMISSIONSLEDGER_H */
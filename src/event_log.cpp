@@ -0,0 +1,221 @@
+#include "event_log.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace EVLOG {
+
+namespace {
+
+#define RING_SIZE 4096 /** Records per thread, power of two */
+
+// Single producer (owning thread) single consumer (drain thread) ring
+struct ThreadRing {
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<uint64_t> dropped;
+    EventRecord           records[RING_SIZE];
+
+    ThreadRing() : head(0), tail(0), dropped(0) {}
+};
+
+std::mutex                               registryLock;
+std::vector<std::shared_ptr<ThreadRing>> rings;
+thread_local ThreadRing*                 localRing = nullptr;
+
+std::mutex              drainLock;   /** Serializes draining and guards the output file */
+std::ofstream           outfile;
+std::thread             drainThread;
+std::condition_variable drainWake;
+bool                    drainStop = false;
+std::atomic<bool>       fileOpen(false); /** Records are only queued while a file is being written */
+
+
+ThreadRing&
+get_ring()
+{
+    if ( localRing == nullptr ){
+        std::lock_guard<std::mutex> guard(registryLock);
+        std::shared_ptr<ThreadRing> ring(new ThreadRing());
+        rings.push_back(ring);
+        localRing = ring.get();
+    }
+
+    return *localRing;
+}
+
+
+void
+drain_rings()
+{
+    std::vector<std::shared_ptr<ThreadRing>> snapshot;
+    {
+        std::lock_guard<std::mutex> guard(registryLock);
+        snapshot = rings;
+    }
+
+    for (auto& ring: snapshot){
+        uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint32_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail){
+            if ( outfile.is_open() )
+                outfile.write(reinterpret_cast<char const*>(&ring->records[tail & (RING_SIZE-1)]), sizeof(EventRecord));
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+}
+
+
+void
+drain_loop()
+{
+    std::unique_lock<std::mutex> guard(drainLock);
+    while ( !drainStop ){
+        drainWake.wait_for(guard, std::chrono::milliseconds(20));
+        drain_rings();
+    }
+    drain_rings();
+}
+
+}
+
+
+void
+log(EventType type, int simTime, int id, float value)
+{
+    if ( !fileOpen.load(std::memory_order_relaxed) )
+        return;
+
+    ThreadRing& ring = get_ring();
+    uint32_t head = ring.head.load(std::memory_order_relaxed);
+    uint32_t tail = ring.tail.load(std::memory_order_acquire);
+    if ( head - tail >= RING_SIZE ){
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    EventRecord& record = ring.records[head & (RING_SIZE-1)];
+    std::fill(record.reserved, record.reserved + sizeof(record.reserved), 0);
+    record.type    = type;
+    record.simTime = simTime;
+    record.id      = id;
+    record.value   = value;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+
+int
+open_file(std::string const& path)
+{
+    close_file();
+
+    std::lock_guard<std::mutex> guard(drainLock);
+    drain_rings(); // Events from before the file was opened are not written
+    {
+        std::lock_guard<std::mutex> registryGuard(registryLock);
+        for (auto& ring: rings)
+            ring->dropped = 0;
+    }
+    outfile.open(path.c_str(), std::ios::binary | std::ios::trunc);
+    if ( !outfile.is_open() )
+        return -1;
+    outfile.write("EBEVLOG1", 8);
+
+    drainStop = false;
+    fileOpen = true;
+    drainThread = std::thread(drain_loop);
+
+    return 0;
+}
+
+
+void
+close_file()
+{
+    fileOpen = false;
+    if ( drainThread.joinable() ){
+        {
+            std::lock_guard<std::mutex> guard(drainLock);
+            drainStop = true;
+        }
+        drainWake.notify_all();
+        drainThread.join();
+    }
+
+    std::lock_guard<std::mutex> guard(drainLock);
+    if ( outfile.is_open() )
+        outfile.close();
+}
+
+
+void
+flush()
+{
+    std::lock_guard<std::mutex> guard(drainLock);
+    drain_rings();
+    if ( outfile.is_open() )
+        outfile.flush();
+}
+
+
+uint64_t
+get_dropped()
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    uint64_t dropped = 0;
+    for (auto& ring: rings)
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+
+    return dropped;
+}
+
+
+void
+EventCounter::log(EventType type, int simTime, int id, float value)
+{
+    _counts[type].fetch_add(1, std::memory_order_relaxed);
+    EVLOG::log(type, simTime, id, value);
+}
+
+
+std::vector<uint64_t>
+EventCounter::get_counts() const
+{
+    std::vector<uint64_t> counts(eEND, 0);
+    for (int i = 0; i < eEND; ++i)
+        counts[i] = _counts[i].load(std::memory_order_relaxed);
+
+    return counts;
+}
+
+
+void
+EventCounter::assign(EventCounter const& other)
+{
+    for (int i = 0; i < eEND; ++i)
+        _counts[i] = other._counts[i].load(std::memory_order_relaxed);
+}
+
+
+void
+EventCounter::reset()
+{
+    for (int i = 0; i < eEND; ++i)
+        _counts[i] = 0;
+}
+
+namespace {
+
+// Drain thread must be joined before the statics above are destroyed
+struct CloseAtExit {
+    ~CloseAtExit() { close_file(); }
+} closeAtExit;
+
+}
+
+} // namespace EVLOG
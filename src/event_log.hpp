@@ -0,0 +1,83 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * Typed simulation event log. Every thread writes into its own lock-free ring which a
+ * background thread drains to a binary file, events are dropped rather than blocking when
+ * a ring is full. Counts per event type are kept by each manager's EventCounter whether or not
+ * a file is open.
+ *
+ * The rings and the file belong to the python module this is compiled into, so BusManager and
+ * UtilityManager each write their own file through their own set_eventLog.
+ *
+ * File format: 8 byte magic "EBEVLOG1" followed by packed EventRecords in native byte order,
+ * reserved bytes are zero
+ */
+namespace EVLOG {
+
+enum EventType {
+    eNONE              = 0,
+    eSTRANDED_BUS      = 1,  /** id = bus,     value = kWh needed for the route    */
+    eSOC_CLAMP         = 2,  /** id = bus,     value = kWh charged up to max SoC   */
+    eFORCED_CHARGE     = 3,  /** id = bus,     value = SoC below min while charged */
+    ePLUG_EXHAUSTED    = 4,  /** id = bus,     value = charger id                  */
+    eSOLVER_FAILURE    = 5,  /** id = status,  value = demand MW                   */
+    eSOLVER_FALLBACK   = 6,  /** id = 0,       value = MW held from the last step  */
+    eEND
+};
+
+struct EventRecord {
+    uint8_t type;
+    uint8_t reserved[3];
+    int32_t simTime;
+    int32_t id;
+    float   value;
+};
+
+static char const* const eventTypeNames[eEND] = {
+    "none", "stranded_bus", "soc_clamp", "forced_charge", "plug_exhausted", "solver_failure",
+    "solver_fallback"
+};
+
+/** Writes to the event file if one is open, counting is left to the caller's EventCounter */
+void log(EventType type, int simTime, int id, float value);
+
+/** Starts draining to path in the background, close_file drains what is left and stops */
+int  open_file(std::string const& path);
+void close_file();
+void flush();
+
+/** Events lost to full rings since the event file was opened */
+uint64_t get_dropped();
+
+
+/**
+ * Counts per event type for one manager, so scenarios run side by side do not see or clear
+ * each other's counts. Counting is lock free so the per charger handlers may log concurrently.
+ */
+class EventCounter
+{
+public:
+    EventCounter() {reset();}
+
+    /** Counts the event and forwards it to the event file */
+    void log(EventType type, int simTime, int id, float value);
+
+    std::vector<uint64_t> get_counts() const;
+    /** Takes over another counter's counts, for forked managers */
+    void assign(EventCounter const& other);
+    void reset();
+
+private:
+    std::atomic<uint64_t> _counts[eEND];
+};
+
+} // namespace EVLOG
+
+
+#endif /** EVENTLOG_H */
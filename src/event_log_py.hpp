@@ -0,0 +1,55 @@
+#ifndef EVENTLOGPY_H
+#define EVENTLOGPY_H
+
+#include "event_log.hpp"
+#include "failure_ledger.hpp"
+#include <boost/python.hpp>
+
+namespace EVLOG {
+
+/** Converts a manager's counts into {event type name: count} plus the module's "dropped" */
+inline boost::python::dict
+counts_toDict(EventCounter const& counter)
+{
+    boost::python::dict counts;
+    std::vector<uint64_t> typeCounts = counter.get_counts();
+
+    for (int type = eSTRANDED_BUS; type < eEND; ++type)
+        counts[eventTypeNames[type]] = typeCounts[type];
+    counts["dropped"] = get_dropped();
+
+    return counts;
+}
+
+
+/** Converts a ledger into {failure type name: count} plus "infeasible" and "first_infeasible" */
+inline boost::python::dict
+failures_toDict(FailureLedger const& ledger)
+{
+    boost::python::dict counts;
+    std::vector<uint64_t> typeCounts = ledger.get_counts();
+
+    for (int type = 0; type < eFAILURE_END; ++type)
+        counts[failureTypeNames[type]] = typeCounts[type];
+    counts["infeasible"] = ledger.is_infeasible();
+    counts["first_infeasible"] = ledger.get_firstInfeasibleTime();
+
+    return counts;
+}
+
+
+/** Converts the kept failure records into a time ordered list of (type name, simTime, id, value) */
+inline boost::python::list
+failures_toList(FailureLedger const& ledger)
+{
+    boost::python::list records;
+    for (auto& rec: ledger.get_records())
+        records.append(boost::python::make_tuple(failureTypeNames[rec.type], rec.simTime, rec.id, rec.value));
+
+    return records;
+}
+
+} // namespace EVLOG
+
+
+#endif /** EVENTLOGPY_H */
@@ -0,0 +1,131 @@
+#include "failure_ledger.hpp"
+#include <algorithm>
+
+namespace EVLOG {
+
+namespace {
+
+// Event log type each failure is mirrored as
+EventType const failureEventTypes[eFAILURE_END] = {
+    eSTRANDED_BUS, eFORCED_CHARGE, ePLUG_EXHAUSTED, eSOLVER_FAILURE,
+    eSOLVER_FAILURE, eSOLVER_FAILURE, eSOLVER_FALLBACK
+};
+
+}
+
+
+FailureLedger::FailureLedger(std::shared_ptr<EventCounter> events)
+:
+    _events(events)
+{
+    reset();
+}
+
+
+void
+FailureLedger::record(FailureType type, int simTime, int id, float value)
+{
+    if ( _events )
+        _events->log(failureEventTypes[type], simTime, id, value);
+    else
+        log(failureEventTypes[type], simTime, id, value);
+    _counts[type].fetch_add(1, std::memory_order_relaxed);
+
+    if ( type == eSTRANDED_DEPARTURE || type == eINFEASIBLE_SOLVE ){
+        int first = _firstInfeasibleTime.load(std::memory_order_relaxed);
+        while ( (first < 0 || simTime < first) &&
+                !_firstInfeasibleTime.compare_exchange_weak(first, simTime, std::memory_order_relaxed) );
+    }
+
+    // Slots are claimed once, readers only look after the step that wrote them has joined
+    uint32_t slot = _numRecords.fetch_add(1, std::memory_order_relaxed);
+    if ( slot >= MAX_FAILURE_RECORDS )
+        return;
+
+    FailureRecord& rec = _records[slot];
+    std::fill(rec.reserved, rec.reserved + sizeof(rec.reserved), 0); // Records are checkpointed as bytes
+    rec.type    = type;
+    rec.simTime = simTime;
+    rec.id      = id;
+    rec.value   = value;
+}
+
+
+std::vector<uint64_t>
+FailureLedger::get_counts() const
+{
+    std::vector<uint64_t> counts(eFAILURE_END, 0);
+    for (int i = 0; i < eFAILURE_END; ++i)
+        counts[i] = _counts[i].load(std::memory_order_relaxed);
+
+    return counts;
+}
+
+
+std::vector<FailureRecord>
+FailureLedger::get_records() const
+{
+    uint32_t numRecords = std::min<uint32_t>(_numRecords.load(std::memory_order_acquire), MAX_FAILURE_RECORDS);
+    std::vector<FailureRecord> records(_records, _records + numRecords);
+
+    // Concurrent handlers claim slots out of time order
+    std::stable_sort(records.begin(), records.end(), [](FailureRecord const& lhs, FailureRecord const& rhs) {
+        return lhs.simTime < rhs.simTime;
+    });
+
+    return records;
+}
+
+
+bool
+FailureLedger::is_infeasible() const
+{
+    return _firstInfeasibleTime.load(std::memory_order_relaxed) >= 0;
+}
+
+
+void
+FailureLedger::save_state(CKPT::Writer& out) const
+{
+    out.put_vector(get_counts());
+    out.put<int32_t>(get_firstInfeasibleTime());
+    out.put<uint32_t>(_numRecords.load(std::memory_order_relaxed));
+    uint32_t numRecords = std::min<uint32_t>(_numRecords.load(std::memory_order_relaxed), MAX_FAILURE_RECORDS);
+    out.put_vector(std::vector<FailureRecord>(_records, _records + numRecords));
+}
+
+
+bool
+FailureLedger::restore_state(CKPT::Reader& in)
+{
+    std::vector<uint64_t> counts;
+    std::vector<FailureRecord> records;
+    int32_t firstInfeasibleTime = -1;
+    uint32_t numRecords = 0;
+    in.get_vector(counts);
+    in.get(firstInfeasibleTime);
+    in.get(numRecords);
+    in.get_vector(records);
+    if ( !in.ok() || counts.size() != eFAILURE_END || records.size() > MAX_FAILURE_RECORDS )
+        return false;
+
+    for (int i = 0; i < eFAILURE_END; ++i)
+        _counts[i] = counts[i];
+    std::copy(records.begin(), records.end(), _records);
+    _numRecords = numRecords;
+    _firstInfeasibleTime = firstInfeasibleTime;
+
+    return true;
+}
+
+
+void
+FailureLedger::reset()
+{
+    for (int i = 0; i < eFAILURE_END; ++i)
+        _counts[i] = 0;
+    _numRecords = 0;
+    _firstInfeasibleTime = -1;
+}
+
+} // namespace EVLOG
@@ -0,0 +1,81 @@
+#ifndef FAILURELEDGER_H
+#define FAILURELEDGER_H
+
+#include "event_log.hpp"
+#include "checkpoint.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * Per run accounting of the ways a scenario can fail. Unlike the event log which is process
+ * wide and diagnostic, each manager owns a ledger so a sweep can tell good runs from broken
+ * ones and stop a scenario as soon as it is known to be infeasible.
+ *
+ * Counts are always exact, the first MAX_FAILURE_RECORDS failures also keep a timestamped
+ * record. Recording is lock free so the per charger handlers may record concurrently.
+ */
+namespace EVLOG {
+
+#define MAX_FAILURE_RECORDS 1024
+
+enum FailureType {
+    eSTRANDED_DEPARTURE = 0,  /** id = bus,     value = kWh needed for the route         */
+    eFORCED_CHARGING    = 1,  /** id = bus,     value = SoC below min while charged      */
+    ePLUG_STARVED       = 2,  /** id = bus,     value = charger id, bus needed to charge */
+    eINFEASIBLE_SOLVE   = 3,  /** id = status,  value = demand MW                        */
+    eTIME_LIMITED_SOLVE = 4,  /** id = status,  value = demand MW                        */
+    eSOLVER_ERROR       = 5,  /** id = code,    value = demand MW                        */
+    eFALLBACK_DISPATCH  = 6,  /** id = 0,       value = MW held from the previous step   */
+    eFAILURE_END
+};
+
+static char const* const failureTypeNames[eFAILURE_END] = {
+    "stranded_departure", "forced_charging", "plug_starved", "infeasible_solve",
+    "time_limited_solve", "solver_error", "fallback_dispatch"
+};
+
+struct FailureRecord {
+    uint8_t type;
+    uint8_t reserved[3];
+    int32_t simTime;
+    int32_t id;
+    float   value;
+};
+
+class FailureLedger
+{
+public:
+    /** Failures are also logged through events, a manager's counter when given */
+    explicit FailureLedger(std::shared_ptr<EventCounter> events = nullptr);
+
+    /** Also forwards to the event log so event files and counts see every failure */
+    void record(FailureType type, int simTime, int id, float value);
+
+    uint64_t get_count(FailureType type) const {return _counts[type].load(std::memory_order_relaxed);}
+    std::vector<uint64_t> get_counts() const;
+    std::vector<FailureRecord> get_records() const;
+
+    /** A stranded departure or infeasible solve means the scenario can not be completed as planned */
+    bool is_infeasible() const;
+    int get_firstInfeasibleTime() const {return _firstInfeasibleTime.load(std::memory_order_relaxed);}
+
+    void reset();
+
+    /** Restoring must read the end of the blob, the ledger is left untouched unless it all checks out */
+    void save_state(CKPT::Writer& out) const;
+    bool restore_state(CKPT::Reader& in);
+
+private:
+    std::shared_ptr<EventCounter> _events;
+    std::atomic<uint64_t> _counts[eFAILURE_END];
+    std::atomic<uint32_t> _numRecords;
+    std::atomic<int>      _firstInfeasibleTime;
+    FailureRecord         _records[MAX_FAILURE_RECORDS];
+};
+
+} // namespace EVLOG
+
+
+#endif /** FAILURELEDGER_H */
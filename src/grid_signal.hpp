@@ -0,0 +1,119 @@
+#ifndef GRIDSIGNAL_H
+#define GRIDSIGNAL_H
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+namespace NRG {
+
+/** Marginal plant's cost and emissions for the dispatch step starting at simTime */
+struct GridSample {
+    int32_t simTime;
+    float   cost;          /** $/MWh     */
+    float   carbonDioxide; /** Per MWh   */
+};
+
+/**
+ * Per step marginal cost and emissions published by the utility and read by the bus manager in
+ * the same process, so charging can follow the grid without a round trip through Python. The
+ * python class is registered by the UtilityManager module, the BusManager module only takes one.
+ *
+ * Samples are kept in time order. The utility steps after the buses, so a bus step at simTime
+ * sees the dispatch of the step before it.
+ */
+class GridSignal
+{
+public:
+    GridSignal() : _costSum(0.0), _carbonSum(0.0) {}
+
+    /** A sample at or before the last one replaces the history from that time on */
+    void publish(int simTime, double cost, double carbonDioxide) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        while ( !_samples.empty() && _samples.back().simTime >= simTime ){
+            _costSum   -= _samples.back().cost;
+            _carbonSum -= _samples.back().carbonDioxide;
+            _samples.pop_back();
+        }
+        _samples.push_back(GridSample{simTime, (float)cost, (float)carbonDioxide});
+        _costSum   += _samples.back().cost;
+        _carbonSum += _samples.back().carbonDioxide;
+    }
+
+    /** Latest sample before simTime, false if there is none yet */
+    bool get_sample(int simTime, GridSample& sample) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = std::lower_bound(_samples.begin(), _samples.end(), simTime,
+                                   [](GridSample const& lhs, int time){ return lhs.simTime < time; });
+        if ( it == _samples.begin() )
+            return false;
+
+        sample = *(it - 1);
+        return true;
+    }
+
+    /**
+     * Weighted cost and emissions of the latest sample before simTime relative to the mean of
+     * every sample so far, so 1 is an average step and lower is cheaper and cleaner. A signal
+     * with no samples or a zero mean reads as average.
+     */
+    double get_index(int simTime, double costWeight, double carbonWeight) const {
+        GridSample sample;
+        if ( costWeight + carbonWeight <= 0.0 || !get_sample(simTime, sample) )
+            return 1.0;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        double costMean   = _costSum / _samples.size();
+        double carbonMean = _carbonSum / _samples.size();
+        double costIdx    = (costMean > 0.0) ? sample.cost / costMean : 1.0;
+        double carbonIdx  = (carbonMean > 0.0) ? sample.carbonDioxide / carbonMean : 1.0;
+
+        return (costWeight * costIdx + carbonWeight * carbonIdx) / (costWeight + carbonWeight);
+    }
+
+    /** Room for numSamples samples so publishing does not allocate */
+    void reserve(size_t numSamples) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _samples.reserve(numSamples);
+    }
+
+    size_t get_numSamples() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _samples.size();
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _samples.clear();
+        _costSum   = 0.0;
+        _carbonSum = 0.0;
+    }
+
+    std::vector<GridSample> get_samples() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _samples;
+    }
+
+    /** Replaces the history, used to restore a checkpoint */
+    void set_samples(std::vector<GridSample> samples) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _samples.swap(samples);
+        _costSum = _carbonSum = 0.0;
+        for (auto const& sample: _samples){
+            _costSum   += sample.cost;
+            _carbonSum += sample.carbonDioxide;
+        }
+    }
+
+private:
+    mutable std::mutex _mutex;
+    std::vector<GridSample> _samples;
+    double _costSum;
+    double _carbonSum;
+};
+
+} // namespace NRG
+
+
+#endif /** GRIDSIGNAL_H */
@@ -0,0 +1,112 @@
+#include "plant_table.hpp"
+#include <algorithm>
+
+namespace NRG {
+
+PlantTable::PlantTable()
+:
+    _fuels({
+        {   "Biomass",      {  0.0, 0.0, 0.0}, false   },
+        {   "CoalPlant",    {960.6, 0.0, 0.0}, false   },
+        {   "Hydro",        {  0.0, 0.0, 0.0}, false   },
+        {   "NatGasPlant",  {505.0, 0.0, 0.0}, false   },
+        {   "NuclearPlant", {  0.0, 0.0, 0.0}, false   },
+        {   "Solar",        {  0.0, 0.0, 0.0}, true    },
+        {   "Wind",         {  0.0, 0.0, 0.0}, true    }
+    })
+{}
+
+
+int
+PlantTable::set_fuel(FuelType const& fuel)
+{
+    int fuelIdx = find_fuel(fuel.name);
+    if ( fuelIdx < 0 ){
+        _fuels.push_back(fuel);
+        return _fuels.size() - 1;
+    }
+
+    _fuels[fuelIdx] = fuel;
+    for (size_t plant = 0; plant < _fuel.size(); ++plant){
+        if ( _fuel[plant] == fuelIdx )
+            _rate[plant] = fuel.rate;
+    }
+    return fuelIdx;
+}
+
+
+int
+PlantTable::find_fuel(std::string const& name) const
+{
+    for (size_t idx = 0; idx < _fuels.size(); ++idx){
+        if ( _fuels[idx].name == name )
+            return idx;
+    }
+
+    return -1;
+}
+
+
+size_t
+PlantTable::add_plant(EnergySourceParameters const& esp, int fuelIdx)
+{
+    _names.push_back(esp.name);
+    _fuel.push_back(fuelIdx);
+    _maxOutput.push_back(esp.maxCapacity);
+    _minOutput.push_back(esp.minCapacity);
+    _rampRate.push_back(esp.rampRate);
+    _runCost.push_back(esp.runCost);
+    _rampCost.push_back(esp.rampCost);
+    _startupCost.push_back(esp.startupCost);
+    _rate.push_back(_fuels[fuelIdx].rate);
+    _currPower.push_back(0.0);
+    _currState.push_back(SourceState::e_SSOFF);
+
+    return _names.size() - 1;
+}
+
+
+void
+PlantTable::set_powerPoint(size_t plant, double power, bool overrideRamps)
+{
+    if ( overrideRamps ){
+        _currPower[plant] = power;
+        return;
+    }
+
+    // Ramp limits here use the rate as given, the dispatch bounds already hold it to the percentage
+    double maxChange = _maxOutput[plant] * _rampRate[plant];
+    _currPower[plant] = std::max(std::min(_currPower[plant] + maxChange, power), _currPower[plant] - maxChange);
+}
+
+
+Emissions
+PlantTable::get_emissionsOutput() const
+{
+    Emissions total = {0.0, 0.0, 0.0};
+    for (size_t plant = 0; plant < _currPower.size(); ++plant)
+        total += _rate[plant] * _currPower[plant];
+
+    return total;
+}
+
+
+double
+PlantTable::get_currPower() const
+{
+    double total = 0.0;
+    for (auto& power: _currPower)
+        total += power;
+
+    return total;
+}
+
+
+void
+PlantTable::reset()
+{
+    std::fill(_currPower.begin(), _currPower.end(), 0.0);
+    std::fill(_currState.begin(), _currState.end(), SourceState::e_SSOFF);
+}
+
+} // namespace NRG
@@ -0,0 +1,136 @@
+#ifndef PLANTTABLE_H
+#define PLANTTABLE_H
+
+#include <string>
+#include <vector>
+
+namespace NRG {
+
+#define     SUCCESS 0
+#define     FAILURE 1
+
+
+struct EnergySourceParameters {
+    std::string  name;         /** Plant name         */
+    double       maxCapacity;  /** MW                 */
+    double       minCapacity;  /** % Max output power */
+    double       runCost;      /** $/MWh              */
+    double       rampRate;     /** % maxCapacity/min  */
+    double       rampCost;     /** $ / delta MW       */
+    double       startupCost;  /** $ / delta MW       */
+};
+
+enum SourceState {
+    e_SSOFF = 0,
+    e_SSON  = 1,
+    e_SSEND
+};
+
+struct Emissions {
+    double carbonDioxide;
+    double methane;
+    double nitrousOxide;
+
+    Emissions operator+(Emissions rhs) const {
+        return {
+            rhs.carbonDioxide + carbonDioxide,
+            rhs.methane + methane,
+            rhs.nitrousOxide + nitrousOxide,
+        };
+    }
+    Emissions& operator+=(Emissions rhs) {
+        carbonDioxide += rhs.carbonDioxide;
+        methane       += rhs.methane;
+        nitrousOxide  += rhs.nitrousOxide;
+        return *this;
+    }
+    Emissions operator*(double scale) const {
+        return {
+            carbonDioxide * scale,
+            methane * scale,
+            nitrousOxide * scale,
+        };
+    }
+};
+
+/** Everything that sets a plant type apart, a row per Type named in the sources file */
+struct FuelType {
+    std::string name;
+    Emissions   rate;         /** Emitted per MWh                                     */
+    bool        uncontrolled; /** Output follows a production trace, not the dispatch */
+};
+
+/**
+ * Every plant as a row of flat columns, with what depends on the plant type looked up from a
+ * fuel row. Plants are indexed in the order they were added. A new plant type is a new fuel
+ * row, and emissions and costs are a single pass over the columns.
+ */
+class PlantTable
+{
+public:
+    /** Starts with the fuel types of the shipped sources file */
+    PlantTable();
+
+    /** Adds a fuel type or replaces the one with the same name, plants already added follow it */
+    int set_fuel(FuelType const& fuel);
+    /** Index of the named fuel, -1 if there is none */
+    int find_fuel(std::string const& name) const;
+    FuelType const& get_fuel(int fuelIdx) const {return _fuels[fuelIdx];}
+
+    /** Index of the new plant */
+    size_t add_plant(EnergySourceParameters const& esp, int fuelIdx);
+    size_t size() const {return _names.size();}
+
+    std::string const& get_name(size_t plant) const {return _names[plant];}
+    int get_fuelIdx(size_t plant) const {return _fuel[plant];}
+    bool is_uncontrolled(size_t plant) const {return _fuels[_fuel[plant]].uncontrolled;}
+    double get_powerCost(size_t plant) const {return _runCost[plant];}
+    double get_rampCost(size_t plant) const {return _rampCost[plant];}
+    double get_startupCost(size_t plant) const {return _startupCost[plant];}
+    double get_maxOutputPower(size_t plant) const {return _maxOutput[plant];}
+    /** Min output is given as a percentage of max output */
+    double get_minOutputPower(size_t plant) const {return _maxOutput[plant] * (_minOutput[plant] / 100.0);}
+    double get_maxPositiveRamp(size_t plant) const {return _rampRate[plant] / 100.0;}
+    double get_maxNegativeRamp(size_t plant) const {return _rampRate[plant] / 100.0;}
+    double get_currPower(size_t plant) const {return _currPower[plant];}
+    SourceState get_currState(size_t plant) const {return _currState[plant];}
+    Emissions const& get_emissionsRate(size_t plant) const {return _rate[plant];}
+
+    /** Power of every plant and its rate per MWh, in plant order */
+    double const* get_powers() const {return _currPower.data();}
+    Emissions const* get_emissionsRates() const {return _rate.data();}
+
+    void set_powerPoint(size_t plant, double power, bool overrideRamps = false);
+
+    /** Power point and state restored from a checkpoint, ramp limits are not applied */
+    void restore_powerPoint(size_t plant, double power, SourceState state) {_currPower[plant] = power; _currState[plant] = state;}
+
+    /** Emitted per hour by all plants at their current power points */
+    Emissions get_emissionsOutput() const;
+    /** Total MW of all plants */
+    double get_currPower() const;
+
+    /** Every plant off and at zero */
+    void reset();
+
+private:
+    std::vector<FuelType> _fuels;
+
+    // Plant columns
+    std::vector<std::string> _names;
+    std::vector<int>         _fuel;
+    std::vector<double>      _maxOutput;   /** MW                 */
+    std::vector<double>      _minOutput;   /** % Max output power */
+    std::vector<double>      _rampRate;    /** % maxCapacity/min  */
+    std::vector<double>      _runCost;     /** $/MWh              */
+    std::vector<double>      _rampCost;    /** $ / delta MW       */
+    std::vector<double>      _startupCost; /** $ / delta MW       */
+    std::vector<Emissions>   _rate;        /** Copied from the fuel row so passes stay contiguous */
+    std::vector<double>      _currPower;   /** MW                 */
+    std::vector<SourceState> _currState;
+};
+
+} // namespace NRG
+
+
+#endif /** PLANTTABLE_H */
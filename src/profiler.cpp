@@ -0,0 +1,189 @@
+#include "profiler.hpp"
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+namespace PROF {
+
+namespace {
+
+struct PhaseAccum {
+    uint64_t calls;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t histogram[PROF_HIST_BUCKETS];
+};
+
+struct TraceEvent {
+    int      phase;
+    uint64_t startNs;
+    uint64_t durNs;
+};
+
+struct ThreadData {
+    int threadId;
+    std::vector<PhaseAccum> phases;
+    std::vector<TraceEvent> trace;
+};
+
+// Thread blocks are owned here so they outlive the threads that filled them
+std::mutex                               registryLock;
+std::vector<std::string>                 phaseNames;
+std::vector<std::shared_ptr<ThreadData>> threadBlocks;
+Clock::time_point                        epoch = Clock::now();
+std::string                              traceFile;
+std::atomic<bool>                        traceEnabled(false);
+
+thread_local ThreadData* localData = nullptr;
+
+
+PhaseAccum&
+get_accum(int phase)
+{
+    if ( localData == nullptr ){
+        std::lock_guard<std::mutex> guard(registryLock);
+        std::shared_ptr<ThreadData> data(new ThreadData());
+        data->threadId = threadBlocks.size();
+        threadBlocks.push_back(data);
+        localData = data.get();
+    }
+
+    if ( phase >= (int)localData->phases.size() )
+        localData->phases.resize(phase + 1, PhaseAccum());
+
+    return localData->phases[phase];
+}
+
+}
+
+
+int
+register_phase(char const* name)
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    for (size_t i = 0; i < phaseNames.size(); ++i){
+        if ( phaseNames[i] == name )
+            return i;
+    }
+    phaseNames.push_back(name);
+
+    return phaseNames.size() - 1;
+}
+
+
+void
+record(int phase, Clock::time_point start, Clock::time_point end)
+{
+    uint64_t durNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    PhaseAccum& accum = get_accum(phase);
+
+    accum.calls++;
+    accum.totalNs += durNs;
+    if ( durNs > accum.maxNs )
+        accum.maxNs = durNs;
+
+    int bucket = 0;
+    for (uint64_t ns = durNs; ns > 1 && bucket < PROF_HIST_BUCKETS - 1; ns >>= 1)
+        bucket++;
+    accum.histogram[bucket]++;
+
+    if ( traceEnabled ){
+        TraceEvent event = { phase, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch).count(), durNs };
+        localData->trace.push_back(event);
+    }
+}
+
+
+void
+count(int phase, uint64_t n)
+{
+    get_accum(phase).calls += n;
+}
+
+
+std::vector<PhaseStats>
+get_stats()
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    std::vector<PhaseStats> stats(phaseNames.size());
+
+    for (size_t phase = 0; phase < phaseNames.size(); ++phase){
+        PhaseStats& ps = stats[phase];
+        uint64_t totalNs = 0, maxNs = 0;
+        ps.name  = phaseNames[phase];
+        ps.calls = 0;
+        std::fill(ps.histogram, ps.histogram + PROF_HIST_BUCKETS, 0);
+
+        for (auto& data: threadBlocks){
+            if ( phase >= data->phases.size() )
+                continue;
+            PhaseAccum const& accum = data->phases[phase];
+            ps.calls += accum.calls;
+            totalNs  += accum.totalNs;
+            maxNs     = std::max(maxNs, accum.maxNs);
+            for (int b = 0; b < PROF_HIST_BUCKETS; ++b)
+                ps.histogram[b] += accum.histogram[b];
+        }
+        ps.totalSec = totalNs * 1e-9;
+        ps.maxSec   = maxNs * 1e-9;
+    }
+
+    return stats;
+}
+
+
+void
+reset()
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    for (auto& data: threadBlocks){
+        std::fill(data->phases.begin(), data->phases.end(), PhaseAccum());
+        data->trace.clear();
+    }
+    epoch = Clock::now();
+}
+
+
+void
+set_traceFile(std::string const& path)
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    traceFile    = path;
+    traceEnabled = !path.empty();
+}
+
+
+int
+write_trace()
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    if ( !traceEnabled )
+        return 0;
+
+    // Chrome trace-event format, complete events with microsecond timestamps
+    std::ofstream outfile(traceFile.c_str());
+    if ( !outfile.is_open() )
+        return -1;
+
+    outfile << std::fixed << std::setprecision(3);
+    outfile << "{\"traceEvents\":[";
+    bool first = true;
+    for (auto& data: threadBlocks){
+        for (auto& event: data->trace){
+            outfile << (first ? "" : ",") << std::endl
+                    << "{\"name\":\"" << phaseNames[event.phase] << "\",\"ph\":\"X\",\"pid\":1"
+                    << ",\"tid\":" << data->threadId
+                    << ",\"ts\":" << event.startNs / 1000.0
+                    << ",\"dur\":" << event.durNs / 1000.0 << "}";
+            first = false;
+        }
+    }
+    outfile << std::endl << "]}" << std::endl;
+    outfile.close();
+
+    return 0;
+}
+
+} // namespace PROF
@@ -0,0 +1,73 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * Scoped phase timers and counters. Each thread accumulates into its own block so timing
+ * inside parallel sections needs no locking, blocks are summed when stats are requested.
+ * Define NO_PROFILING to compile every PROF_ macro out. Stats belong to the python module this
+ * is compiled into, BusManager and UtilityManager each keep their own.
+ */
+namespace PROF {
+
+using Clock = std::chrono::steady_clock;
+
+#define PROF_HIST_BUCKETS 32 /** Bucket k counts durations in [2^k, 2^(k+1)) ns */
+
+struct PhaseStats {
+    std::string name;
+    uint64_t    calls;
+    double      totalSec;
+    double      maxSec;
+    uint64_t    histogram[PROF_HIST_BUCKETS];
+};
+
+int  register_phase(char const* name);
+void record(int phase, Clock::time_point start, Clock::time_point end);
+void count(int phase, uint64_t n);
+
+/** Stats summed over all threads, only call between steps */
+std::vector<PhaseStats> get_stats();
+void reset();
+
+/** Trace events are only kept while a trace file is set, an empty path disables tracing */
+void set_traceFile(std::string const& path);
+int  write_trace();
+
+
+class ScopedTimer
+{
+public:
+    ScopedTimer(int phase) : _phase(phase), _start(Clock::now()) {}
+    ~ScopedTimer() { record(_phase, _start, Clock::now()); }
+
+private:
+    int _phase;
+    Clock::time_point _start;
+
+    ScopedTimer(const ScopedTimer&) = delete;
+};
+
+} // namespace PROF
+
+
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b)  PROF_CONCAT_(a, b)
+
+#ifndef NO_PROFILING
+    #define PROF_SCOPE(name) \
+        static const int PROF_CONCAT(_profPhase, __LINE__) = PROF::register_phase(name); \
+        PROF::ScopedTimer PROF_CONCAT(_profTimer, __LINE__)(PROF_CONCAT(_profPhase, __LINE__))
+    #define PROF_COUNT(name, n) \
+        do{ static const int _profCounter = PROF::register_phase(name); PROF::count(_profCounter, n); }while(0)
+#else
+    #define PROF_SCOPE(name)    do{}while(0)
+    #define PROF_COUNT(name, n) do{}while(0)
+#endif
+
+
+#endif /** PROFILER_H */
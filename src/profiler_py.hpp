@@ -0,0 +1,35 @@
+#ifndef PROFILERPY_H
+#define PROFILERPY_H
+
+#include "profiler.hpp"
+#include <boost/python.hpp>
+
+namespace PROF {
+
+/** Converts get_stats() into {phase: {"calls", "total", "max", "histogram"}} for the python modules */
+inline boost::python::dict
+stats_toDict()
+{
+    namespace bp = boost::python;
+    bp::dict stats;
+
+    for (auto& ps: get_stats()){
+        bp::list histogram;
+        for (int b = 0; b < PROF_HIST_BUCKETS; ++b)
+            histogram.append(ps.histogram[b]);
+
+        bp::dict phase;
+        phase["calls"]     = ps.calls;
+        phase["total"]     = ps.totalSec;
+        phase["max"]       = ps.maxSec;
+        phase["histogram"] = histogram;
+        stats[ps.name] = phase;
+    }
+
+    return stats;
+}
+
+} // namespace PROF
+
+
+#endif /** PROFILERPY_H */
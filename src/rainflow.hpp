@@ -0,0 +1,108 @@
+#ifndef RAINFLOW_H
+#define RAINFLOW_H
+
+#include <math.h>
+#include <vector>
+#include "checkpoint.hpp"
+
+namespace BUS {
+
+/**
+ * Incremental rainflow counter over a SoC series. Samples that keep going the same way only move
+ * the current extreme, a reversal confirms it and runs the three point rule on the residual. Every
+ * reversal is pushed and popped at most once so a sample is O(1) amortized, and the residual of
+ * unclosed half cycles stays a handful of points for a duty cycle.
+ */
+class Rainflow
+{
+public:
+    Rainflow() : _current(0.0), _direction(0) {}
+
+    void reset(double soc) {
+        _turns.assign(1, soc);
+        _current   = soc;
+        _direction = 0;
+    }
+
+    /** Adds a sample, count(depth, cycles) is called with 1 for full and 0.5 for half cycles closed by it */
+    template <typename F>
+    void add(double soc, F count) {
+        if ( _turns.empty() ){
+            reset(soc);
+            return;
+        }
+        int direction = (soc > _current) ? 1 : ((soc < _current) ? -1 : 0);
+        if ( direction == 0 )
+            return;
+        if ( _direction != 0 && direction != _direction ){
+            _turns.push_back(_current);
+            close_cycles(count);
+        }
+        _current   = soc;
+        _direction = direction;
+    }
+
+    /** Depth of the excursion a further move of delta SoC would extend, zero if it starts a new one */
+    double get_openDepth(double delta) const {
+        if ( _turns.empty() || (delta > 0.0) != (_direction > 0) || _direction == 0 )
+            return 0.0;
+
+        return fabs(_current - _turns.back());
+    }
+
+    /** Unclosed excursions, each counts as a half cycle */
+    template <typename F>
+    void get_residual(F count) const {
+        for (size_t idx = 1; idx < _turns.size(); ++idx)
+            count(fabs(_turns[idx] - _turns[idx-1]), 0.5);
+        if ( !_turns.empty() && _direction != 0 )
+            count(fabs(_current - _turns.back()), 0.5);
+    }
+
+    void save_state(CKPT::Writer& out) const {
+        out.put_vector(_turns);
+        out.put(_current);
+        out.put<int32_t>(_direction);
+    }
+
+    bool restore_state(CKPT::Reader& in) {
+        int32_t direction = 0;
+        in.get_vector(_turns);
+        in.get(_current);
+        in.get(direction);
+        _direction = direction;
+
+        return in.good() && direction >= -1 && direction <= 1;
+    }
+
+private:
+    std::vector<double> _turns; /** Confirmed reversals not yet closed, the first is where counting started */
+    double _current;            /** Latest sample, the reversal in progress */
+    int _direction;
+
+    template <typename F>
+    void close_cycles(F count) {
+        while ( _turns.size() >= 3 ){
+            size_t last = _turns.size() - 1;
+            double x = fabs(_turns[last] - _turns[last-1]);
+            double y = fabs(_turns[last-1] - _turns[last-2]);
+            if ( x < y )
+                break;
+
+            if ( _turns.size() == 3 ){
+                // Range holding the starting point only ever closes half a cycle
+                count(y, 0.5);
+                _turns.erase(_turns.begin());
+            }
+            else {
+                count(y, 1.0);
+                _turns.erase(_turns.end() - 3, _turns.end() - 1);
+            }
+        }
+    }
+};
+
+}
+
+
+#endif /** RAINFLOW_H */
@@ -0,0 +1,23 @@
+#ifndef RELEASEGIL_H
+#define RELEASEGIL_H
+
+#include <boost/python.hpp>
+
+/**
+ * Releases the GIL for as long as it is in scope so forked branches can step from several python
+ * threads at once. Nothing inside the scope may touch python objects or raise python errors.
+ */
+class ReleaseGil
+{
+public:
+    ReleaseGil() : _state(PyEval_SaveThread()) {}
+    ~ReleaseGil() {PyEval_RestoreThread(_state);}
+
+private:
+    PyThreadState* _state;
+
+    ReleaseGil(const ReleaseGil&) = delete;
+};
+
+
+#endif /** RELEASEGIL_H */
@@ -0,0 +1,50 @@
+#ifndef RENEWABLETRACE_H
+#define RENEWABLETRACE_H
+
+#include <algorithm>
+#include <vector>
+
+namespace NRG {
+
+/**
+ * Solar or wind production in MW, a sample per minute from the start of the run. Samples never
+ * change once built, so managers replaying the same day hold one trace through a shared pointer
+ * and each keeps its own position into it.
+ */
+class RenewableTrace
+{
+public:
+    RenewableTrace(double const* samples, size_t numSamples, int sampleSeconds = 60)
+    :
+        _samples(samples, samples + numSamples),
+        _sampleSeconds(sampleSeconds)
+    {}
+
+    size_t size() const {return _samples.size();}
+    int get_sampleSeconds() const {return _sampleSeconds;}
+
+    /**
+     * MW at seconds after the first sample. Between samples it holds the earlier one, or with
+     * interpolate is linear between the two. Past the last sample the last one is held.
+     */
+    double get_value(double seconds, bool interpolate) const {
+        if ( _samples.empty() )
+            return 0.0;
+
+        double pos = std::min(std::max(seconds, 0.0) / _sampleSeconds, double(_samples.size() - 1));
+        size_t idx = pos;
+        if ( !interpolate || idx + 1 >= _samples.size() )
+            return _samples[idx];
+
+        return _samples[idx] + (pos - idx) * (_samples[idx + 1] - _samples[idx]);
+    }
+
+private:
+    std::vector<double> const _samples;
+    int const                 _sampleSeconds;
+};
+
+} // namespace NRG
+
+
+#endif /** RENEWABLETRACE_H */
@@ -0,0 +1,90 @@
+#include "route_energy.hpp"
+#include <algorithm>
+#include <math.h>
+
+namespace BUS {
+
+/** Great circle distance in miles */
+static double
+get_stopDistance(double lat1, double lon1, double lat2, double lon2)
+{
+    double const earthRadius = 3958.8;
+    double const toRad = M_PI / 180.0;
+    double dLat = (lat2 - lat1) * toRad;
+    double dLon = (lon2 - lon1) * toRad;
+    double a = sin(dLat/2)*sin(dLat/2) + cos(lat1*toRad)*cos(lat2*toRad)*sin(dLon/2)*sin(dLon/2);
+
+    return 2 * earthRadius * atan2(sqrt(a), sqrt(1 - a));
+}
+
+
+RouteEnergy::RouteEnergy(RouteModel const& model, std::vector<double> const& stopLats, std::vector<double> const& stopLons,
+                         std::vector<double> const& stopElevs, std::vector<int> const& tripOffsets, std::vector<int> const& tripStops)
+{
+    int numTrips = std::max((int)tripOffsets.size() - 1, 0);
+    _tripStart.reserve(numTrips + 1);
+    _segEnd.reserve(tripStops.size());
+    _segMiles.reserve(tripStops.size());
+
+    _tripStart.push_back(0);
+    for (int trip = 0; trip < numTrips; ++trip){
+        double time = 0.0, miles = 0.0;
+        for (int idx = tripOffsets[trip] + 1; idx < tripOffsets[trip + 1]; ++idx){
+            int from = tripStops[idx - 1], to = tripStops[idx];
+            double dist = model.circuity * get_stopDistance(stopLats[from], stopLons[from], stopLats[to], stopLons[to]);
+            double climb = stopElevs[to] - stopElevs[from];
+
+            // Closely spaced stops cost a stop's worth of time and energy more per mile driven
+            time += model.dwellTime + model.stopDelay + 3600.0 * dist / model.cruiseSpeed;
+            double segMiles = dist + model.stopMiles;
+            segMiles += (climb > 0.0) ? model.climbMiles * climb : model.regenFraction * model.climbMiles * climb;
+            miles += std::max(segMiles, 0.0);
+
+            _segEnd.push_back(time);
+            _segMiles.push_back(miles);
+        }
+        _tripStart.push_back(_segEnd.size());
+    }
+}
+
+
+int
+RouteEnergy::get_duration(int tripIdx) const
+{
+    uint32_t last = _tripStart[tripIdx + 1];
+
+    return (last > _tripStart[tripIdx]) ? (int)ceil(_segEnd[last - 1]) : 0;
+}
+
+
+double
+RouteEnergy::get_tripMiles(int tripIdx) const
+{
+    uint32_t last = _tripStart[tripIdx + 1];
+
+    return (last > _tripStart[tripIdx]) ? _segMiles[last - 1] : 0.0;
+}
+
+
+double
+RouteEnergy::get_milesAt(int tripIdx, int elapsed, uint32_t& segment) const
+{
+    uint32_t first = _tripStart[tripIdx], last = _tripStart[tripIdx + 1];
+    if ( first == last || elapsed <= 0 )
+        return 0.0;
+
+    // Steps only move forward so the cursor advances at most a few segments per call
+    segment = std::max(segment, first);
+    while ( segment < last && _segEnd[segment] <= elapsed )
+        segment++;
+    if ( segment == last )
+        return _segMiles[last - 1];
+
+    double startTime  = (segment > first) ? _segEnd[segment - 1] : 0.0;
+    double startMiles = (segment > first) ? _segMiles[segment - 1] : 0.0;
+    double frac = (elapsed - startTime) / (_segEnd[segment] - startTime);
+
+    return startMiles + frac * (_segMiles[segment] - startMiles);
+}
+
+} /** namespace */
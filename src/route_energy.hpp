@@ -0,0 +1,57 @@
+#ifndef ROUTEENERGY_H
+#define ROUTEENERGY_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace BUS {
+
+/** Speed, stop and terrain model used to turn a trip's stops into an energy profile */
+struct RouteModel {
+    double cruiseSpeed;   /** mph between stops                                    */
+    double dwellTime;     /** s standing at each stop                               */
+    double stopDelay;     /** s lost braking for and pulling away from each stop    */
+    double stopMiles;     /** Extra miles worth of energy to get back up to speed   */
+    double climbMiles;    /** Extra miles worth of energy per meter climbed         */
+    double regenFraction; /** Share of the climb energy recovered going back down   */
+    double circuity;      /** Road miles per straight line mile between stops       */
+};
+
+/**
+ * Energy profiles of every trip built once from stop coordinates. Energy is kept as miles at the
+ * bus's consumption rate so one table serves every bus model. Segments of all trips are stored
+ * back to back with cumulative end times and miles, so a trip is a range and a lookup is a read.
+ */
+class RouteEnergy
+{
+public:
+    /**
+     * stopLats, stopLons in degrees and stopElevs in meters are indexed by stop, trip t visits
+     * tripStops[tripOffsets[t]] to tripStops[tripOffsets[t+1]-1] in order
+     */
+    RouteEnergy(RouteModel const& model, std::vector<double> const& stopLats, std::vector<double> const& stopLons,
+                std::vector<double> const& stopElevs, std::vector<int> const& tripOffsets, std::vector<int> const& tripStops);
+
+    int get_numTrips() const {return (int)_tripStart.size() - 1;}
+    /** Trips with fewer than two stops have none */
+    int get_numSegments(int tripIdx) const {return _tripStart[tripIdx + 1] - _tripStart[tripIdx];}
+    /** Seconds from departure to arrival at the last stop */
+    int get_duration(int tripIdx) const;
+    /** Miles worth of energy for the whole trip */
+    double get_tripMiles(int tripIdx) const;
+    /**
+     * Miles worth of energy used elapsed seconds after departure. Energy is spread evenly over
+     * a segment, segment is a cursor into the trip kept by the caller between increasing calls.
+     */
+    double get_milesAt(int tripIdx, int elapsed, uint32_t& segment) const;
+
+private:
+    std::vector<uint32_t> _tripStart; /** First segment of each trip, one past the end last */
+    std::vector<float> _segEnd;       /** Seconds after departure each segment ends         */
+    std::vector<float> _segMiles;     /** Miles worth of energy used by the segment's end   */
+};
+
+}
+
+
+#endif /** ROUTEENERGY_H */
@@ -0,0 +1,66 @@
+#include "tariff.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace BUS {
+
+Tariff::Tariff(std::vector<int> const& periodStarts, std::vector<double> const& prices)
+:
+    _starts(periodStarts),
+    _prices(prices)
+{}
+
+
+int
+Tariff::get_period(int simTime) const
+{
+    int timeOfDay = simTime % SECONDS_PER_DAY;
+
+    return std::upper_bound(_starts.begin(), _starts.end(), timeOfDay) - _starts.begin() - 1;
+}
+
+
+int
+Tariff::get_periodEnd(int simTime, int period) const
+{
+    int dayStart = simTime - (simTime % SECONDS_PER_DAY);
+
+    return dayStart + ((period + 1 < (int)_starts.size()) ? _starts[period + 1] : SECONDS_PER_DAY);
+}
+
+
+int
+Tariff::get_cheaperSeconds(int from, int to, double price) const
+{
+    int seconds = 0;
+    for (int time = from; time < to; ){
+        int period = get_period(time);
+        int end = std::min(get_periodEnd(time, period), to);
+        if ( _prices[period] < price )
+            seconds += end - time;
+        time = end;
+    }
+
+    return seconds;
+}
+
+
+int
+Tariff::get_nextChange(int simTime) const
+{
+    if ( _starts.size() < 2 )
+        return std::numeric_limits<int>::max();
+
+    // Periods wrap at midnight, the last and first may share a price
+    double price = get_price(simTime);
+    int time = simTime;
+    for (size_t count = 0; count <= _starts.size(); ++count){
+        time = get_periodEnd(time, get_period(time));
+        if ( get_price(time) != price )
+            return time;
+    }
+
+    return std::numeric_limits<int>::max();
+}
+
+} /** namespace */
@@ -0,0 +1,37 @@
+#ifndef TARIFF_H
+#define TARIFF_H
+
+#include <vector>
+
+namespace BUS {
+
+#define SECONDS_PER_DAY 86400
+
+/**
+ * Time of use energy prices repeating every day. A day has a few periods so every lookup walks
+ * them directly, windows a bus waits at a charger span at most a handful of periods.
+ */
+class Tariff
+{
+public:
+    /** periodStarts in seconds into the day, increasing from 0, prices in $/kWh */
+    Tariff(std::vector<int> const& periodStarts, std::vector<double> const& prices);
+
+    double get_price(int simTime) const {return _prices[get_period(simTime)];}
+    /** Seconds in [from, to) priced strictly below price */
+    int get_cheaperSeconds(int from, int to, double price) const;
+    /** First time after simTime the price changes */
+    int get_nextChange(int simTime) const;
+
+private:
+    std::vector<int> _starts;
+    std::vector<double> _prices;
+
+    int get_period(int simTime) const;
+    int get_periodEnd(int simTime, int period) const;
+};
+
+}
+
+
+#endif /** TARIFF_H */
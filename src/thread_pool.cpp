@@ -0,0 +1,136 @@
+#include "thread_pool.hpp"
+
+namespace BUS {
+
+ThreadPool::ThreadPool(int numThreads)
+:
+    _task(nullptr),
+    _remaining(0),
+    _generation(0),
+    _stop(false)
+{
+    if ( numThreads < 1 )
+        numThreads = 1;
+
+    for (int i = 0; i < numThreads; ++i)
+        _workers.emplace_back(new Worker());
+
+    // Calling thread acts as worker 0
+    for (int i = 1; i < numThreads; ++i)
+        _threads.emplace_back(&ThreadPool::worker_loop, this, i);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stop = true;
+    }
+    _wake.notify_all();
+
+    for (auto& thread: _threads)
+        thread.join();
+}
+
+
+void
+ThreadPool::parallel_for(int count, std::function<void(int)> const& task)
+{
+    if ( count <= 0 )
+        return;
+
+    if ( _threads.empty() || count == 1 ){
+        for (int idx = 0; idx < count; ++idx)
+            task(idx);
+        return;
+    }
+
+    // Task must be visible before any index can be popped
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _task = &task;
+        _remaining = count;
+    }
+
+    // Hand each worker a contiguous block, idle workers steal from the back of the others
+    int numWorkers = _workers.size();
+    for (int w = 0; w < numWorkers; ++w){
+        std::lock_guard<std::mutex> guard(_workers[w]->lock);
+        for (int idx = (count * w) / numWorkers; idx < (count * (w+1)) / numWorkers; ++idx)
+            _workers[w]->tasks.push_back(idx);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _generation++;
+    }
+    _wake.notify_all();
+
+    run_tasks(0);
+
+    std::unique_lock<std::mutex> guard(_lock);
+    _done.wait(guard, [this]{ return _remaining == 0; });
+    _task = nullptr;
+}
+
+
+void
+ThreadPool::worker_loop(int id)
+{
+    unsigned int seen = 0;
+    while (true){
+        {
+            std::unique_lock<std::mutex> guard(_lock);
+            _wake.wait(guard, [this, seen]{ return _stop || _generation != seen; });
+            if ( _stop )
+                return;
+            seen = _generation;
+        }
+        run_tasks(id);
+    }
+}
+
+
+void
+ThreadPool::run_tasks(int id)
+{
+    int idx;
+    while ( pop_task(id, idx) ){
+        (*_task)(idx);
+        if ( --_remaining == 0 ){
+            std::lock_guard<std::mutex> guard(_lock);
+            _done.notify_all();
+        }
+    }
+}
+
+
+bool
+ThreadPool::pop_task(int id, int& task)
+{
+    {
+        std::lock_guard<std::mutex> guard(_workers[id]->lock);
+        if ( !_workers[id]->tasks.empty() ){
+            task = _workers[id]->tasks.front();
+            _workers[id]->tasks.pop_front();
+            return true;
+        }
+    }
+
+    int numWorkers = _workers.size();
+    for (int offset = 1; offset < numWorkers; ++offset){
+        Worker& victim = *_workers[(id + offset) % numWorkers];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if ( !victim.tasks.empty() ){
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+} /** namespace */
@@ -0,0 +1,54 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace BUS {
+
+/** Persistent pool of workers that each own a task queue and steal from the others when idle */
+class ThreadPool
+{
+public:
+    ThreadPool(int numThreads);
+    ~ThreadPool();
+
+    int get_numThreads() const {return _workers.size();}
+
+    /** Runs task(idx) for idx in [0, count) and returns once all have finished, not reentrant */
+    void parallel_for(int count, std::function<void(int)> const& task);
+
+private:
+    struct Worker {
+        std::mutex      lock;
+        std::deque<int> tasks;
+    };
+
+    std::vector<std::thread> _threads;
+    std::vector<std::unique_ptr<Worker>> _workers;
+
+    std::function<void(int)> const* _task;
+    std::atomic<int> _remaining;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    unsigned int _generation;
+    bool _stop;
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    void worker_loop(int id);
+    void run_tasks(int id);
+    bool pop_task(int id, int& task);
+};
+
+}
+
+
+#endif /** THREADPOOL_H */
@@ -0,0 +1,79 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <vector>
+
+namespace BUS {
+
+/**
+ * Hashed timing wheel of items due at a sim time. Scheduling is O(1) and popping only visits the
+ * slots passed since the last pop, items more than one revolution out wait in their slot until due.
+ */
+template <typename T>
+class TimingWheel
+{
+public:
+    TimingWheel(int slotWidth, int numSlots)
+    :
+        _slotWidth(slotWidth),
+        _slots(numSlots),
+        _cursor(0),
+        _size(0)
+    {}
+
+    void schedule(int time, T const& item) {
+        int tick = time / _slotWidth;
+        // Pops always start from the earliest pending tick
+        if ( _size == 0 || tick < _cursor )
+            _cursor = tick;
+
+        _slots[tick % _slots.size()].push_back(Entry{time, item});
+        _size++;
+    }
+
+    /** Appends every item due at or before time to due */
+    void pop_due(int time, std::vector<T>& due) {
+        int tick = time / _slotWidth;
+        int numSlots = _slots.size();
+        for (int slot = _cursor; _size > 0 && slot <= tick && slot < _cursor + numSlots; ++slot){
+            std::vector<Entry>& entries = _slots[slot % numSlots];
+            for (size_t idx = 0; idx < entries.size(); ){
+                if ( entries[idx].time <= time ){
+                    due.push_back(entries[idx].item);
+                    entries[idx] = entries.back();
+                    entries.pop_back();
+                    _size--;
+                }
+                else
+                    ++idx;
+            }
+        }
+        // The current slot may still hold items later in the same tick
+        if ( tick > _cursor )
+            _cursor = tick;
+    }
+
+    size_t size() const {return _size;}
+
+    void clear() {
+        for (auto& slot: _slots)
+            slot.clear();
+        _size = 0;
+    }
+
+private:
+    struct Entry {
+        int time;
+        T   item;
+    };
+
+    int _slotWidth;
+    std::vector<std::vector<Entry>> _slots;
+    int _cursor; /** First tick not yet fully popped */
+    size_t _size;
+};
+
+}
+
+
+#endif /** TIMINGWHEEL_H */
@@ -1,4 +1,9 @@
 #include "utility_manager.hpp"
+#include "profiler_py.hpp"
+#include "event_log_py.hpp"
+#include "checkpoint_py.hpp"
+#include "release_gil.hpp"
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <iostream>
@@ -16,16 +21,9 @@
 
 namespace NRG {
 
-std::map<std::string, enum EnergyFuels> fuelStringToEnum = {
-    {   "Biomass",      eBIOMASS        },
-    {   "CoalPlant",    eCOAL           },
-    {   "Hydro",        eHYDRO          },
-    {   "NatGasPlant",  eNATURALGAS     },
-    {   "NuclearPlant", eNUCLEAR        },
-    {   "Solar",        eSOLAR          },
-    {   "Wind",         eWIND           }
-};
-
+// Plants whose output follows the solar and wind inputs rather than the dispatch
+static char const* const solarTraceSource = "Solar_(aggregated)_-_base_case";
+static char const* const windTraceSource  = "Wind_(aggregated)_-_base_case";
 
 template< typename T >
 inline
@@ -37,6 +35,16 @@ std::vector< T > to_std_vector( const bp::object& iterable )
 
 
 UtilityManager::UtilityManager()
+:
+    _traceStep(0),
+    _stepSeconds(60),
+    _traceInterpolate(false),
+    _pvPlant(-1),
+    _windPlant(-1),
+    _events(new EVLOG::EventCounter()),
+    _failures(new EVLOG::FailureLedger(_events)),
+    _solveTimeLimit(0.0),
+    _gridSignal(new GridSignal())
 {
 
 }
@@ -94,189 +102,255 @@ UtilityManager::init(bpn::ndarray const& sourceName, bpn::ndarray const& sourceT
 
     double* pvProd   = reinterpret_cast<double*>(pvProduction_MW.get_data());
     double* windProd = reinterpret_cast<double*>(windProduction_MW.get_data());
-    _pvProduction.assign(pvProd, pvProd + dataLen);
-    _windProduction.assign(windProd, windProd + dataLen);
+    _pvTrace.reset(new RenewableTrace(pvProd, dataLen));
+    _windTrace.reset(new RenewableTrace(windProd, dataLen));
+    _traceStep = 0;
+
+    reserve_history();
 
     return ret;
 }
 
 
 int
-UtilityManager::startup(double demandPower)
-{
-    int numSources = _sources.size();
-    std::map<std::string, int> arrayLoc;
-    std::string plantNames[numSources];
-    std::string plantNames_on[numSources];
-    std::string plantNames_prod[numSources];
-    std::string plantNames_indOn[numSources];
-    std::string plantNames_indProd[numSources];
-    double      runCosts[numSources];
-    double      rampCosts[numSources];
-    double      startUpCosts[numSources];
-    double      minCapacity[numSources];
-    double      maxCapacity[numSources];
-
-    int k=0;
-    for (auto& src: _sourceNames)
+UtilityManager::startup(double demandPower, double busPower)
+{
+    PROF_SCOPE("UtilityManager::startup");
+    int numSources = _plants.size();
+    for (int k = 0; k < numSources; ++k)
     {
-        plantNames[k]         = src;
-        plantNames_on[k]      = src + "_on";
-        plantNames_prod[k]    = src + "_cost";
-        plantNames_indOn[k]   = src + "_indOn";
-        plantNames_indProd[k] = src + "_indProd";
-        runCosts[k]         = _sources[src]->get_powerCost() / 60.0; // Divide by 60 MWh -> MW minutes
-        rampCosts[k]        = 0.0;
-        startUpCosts[k]     = 0.0;
-        minCapacity[k]      = _sources[src]->get_minOutputPower();
-        maxCapacity[k]      = _sources[src]->get_maxOutputPower();
-        arrayLoc.insert(std::pair<std::string, int>(src, k)); 
-        k++;
-    }
-    
-    for (auto& ucSrc : _ucSourceNames)
-    {
-        if (ucSrc.compare("Wind_(aggregated)_-_base_case") == 0){
-            LOGDBG("Setting max wind to:  %f", _windProduction.front());
-            maxCapacity[arrayLoc[ucSrc]] = _windProduction.front();
-            minCapacity[arrayLoc[ucSrc]] = _windProduction.front();
-            _windProduction.erase(_windProduction.begin());
-        }
-        if (ucSrc.compare("Solar_(aggregated)_-_base_case") == 0){
-            LOGDBG("Setting max solar to: %f", _pvProduction.front());
-            maxCapacity[arrayLoc[ucSrc]] = _pvProduction.front();
-            minCapacity[arrayLoc[ucSrc]] = _pvProduction.front();
-            _pvProduction.erase(_pvProduction.begin());
-        }
+        _step.runCosts[k]     = _plants.get_powerCost(k) * _stepSeconds / 3600.0; // $/MWh -> $/MW step
+        _step.rampCosts[k]    = 0.0;
+        _step.startupCosts[k] = 0.0;
+        _step.minCapacity[k]  = _plants.get_minOutputPower(k);
+        _step.maxCapacity[k]  = _plants.get_maxOutputPower(k);
     }
 
-    std::map<std::string, double> sourceProd;
-    int ret = run_optimization(numSources, runCosts, rampCosts, startUpCosts, minCapacity, maxCapacity,
-                            plantNames, plantNames_on, plantNames_prod, plantNames_indOn, plantNames_indProd,
-                            arrayLoc, demandPower, sourceProd);
-    
-    std::shared_ptr<std::map<std::string, double>> prodValPtr;
-    std::map<std::string, double> *prodVals = new std::map<std::string, double>;
-    for (auto& src: _sourceNames)
-    {
-        (*prodVals)[src] = sourceProd[src];
-    }
-    set_power(*prodVals, true);
-    prodValPtr.reset(prodVals);
-    _prodValsTime.push_back(prodValPtr);
+    // Traced plants start exactly at the trace
+    apply_traces(true);
+
+    int ret = run_optimization(demandPower);
+    set_power(_step.production.data(), true);
+    record_marginal(busPower);
+    _prodValsTime.insert(_prodValsTime.end(), _step.production.begin(), _step.production.end());
     return ret;
 }
 
 
 int
-UtilityManager::power_request(double demandPower)
-{
-    int numSources = _sources.size();
-    std::map<std::string, int> arrayLoc;
-    std::string plantNames[numSources];
-    std::string plantNames_on[numSources];
-    std::string plantNames_prod[numSources];
-    std::string plantNames_indOn[numSources];
-    std::string plantNames_indProd[numSources];
-    double      runCosts[numSources];
-    double      rampCosts[numSources];
-    double      startUpCosts[numSources];
-    double      minCapacity[numSources];
-    double      maxCapacity[numSources];
-
-    int k=0;
-    for (auto& src: _sourceNames)
+UtilityManager::power_request(double demandPower, double busPower)
+{
+    PROF_SCOPE("UtilityManager::power_request");
+    int numSources = _plants.size();
+    for (int k = 0; k < numSources; ++k)
     {
-        plantNames[k]         = src;
-        plantNames_on[k]      = src + "_on";
-        plantNames_prod[k]    = src + "_cost";
-        plantNames_indOn[k]   = src + "_indOn";
-        plantNames_indProd[k] = src + "_indProd";
-        runCosts[k]         = _sources[src]->get_powerCost() / 60.0; // Divide by 60 MWh -> MW minutes
-        rampCosts[k]        = _sources[src]->get_rampCost();
-        startUpCosts[k]     = _sources[src]->get_startupCost();
-        double maxRampDown  = _sources[src]->get_maxNegativeRamp()*_sources[src]->get_maxOutputPower();
-        double maxRampUp    = _sources[src]->get_maxPositiveRamp()*_sources[src]->get_maxOutputPower();
-        minCapacity[k]      = std::max(_sources[src]->get_minOutputPower(), _sources[src]->get_currPower() - maxRampDown);
-        double maxCap       = std::max(minCapacity[k], _sources[src]->get_currPower() + maxRampUp);
-        maxCapacity[k]      = std::min(_sources[src]->get_maxOutputPower(), maxCap);
-        arrayLoc.insert(std::pair<std::string, int>(src, k)); 
-        k++;
+        _step.runCosts[k]     = _plants.get_powerCost(k) * _stepSeconds / 3600.0; // $/MWh -> $/MW step
+        _step.rampCosts[k]    = _plants.get_rampCost(k);
+        _step.startupCosts[k] = _plants.get_startupCost(k);
+        double maxRampDown    = _plants.get_maxNegativeRamp(k)*_plants.get_maxOutputPower(k) * _stepSeconds / 60.0;
+        double maxRampUp      = _plants.get_maxPositiveRamp(k)*_plants.get_maxOutputPower(k) * _stepSeconds / 60.0;
+        _step.minCapacity[k]  = std::max(_plants.get_minOutputPower(k), _plants.get_currPower(k) - maxRampDown);
+        double maxCap         = std::max(_step.minCapacity[k], _plants.get_currPower(k) + maxRampUp);
+        _step.maxCapacity[k]  = std::min(_plants.get_maxOutputPower(k), maxCap);
     }
-    
-    for (auto& ucSrc : _ucSourceNames)
-    {
-        if (ucSrc.compare("Wind_(aggregated)_-_base_case") == 0){
-            LOGDBG("Setting max wind to:  %f", _windProduction.front());
-            maxCapacity[arrayLoc[ucSrc]] = _windProduction.front();
-            _windProduction.erase(_windProduction.begin());
-        }
-        if (ucSrc.compare("Solar_(aggregated)_-_base_case") == 0){
-            LOGDBG("Setting max solar to: %f", _pvProduction.front());
-            maxCapacity[arrayLoc[ucSrc]] = _pvProduction.front();
-            _pvProduction.erase(_pvProduction.begin());
-        }
+
+    apply_traces(false);
+
+    int ret = run_optimization(demandPower);
+    set_power(_step.production.data());
+    record_marginal(busPower);
+    _prodValsTime.insert(_prodValsTime.end(), _step.production.begin(), _step.production.end());
+    return ret;
+}
+
+
+void
+UtilityManager::apply_traces(bool setMinimum)
+{
+    // The traces are only read, the cursor is what moves so a cleared run can replay the day
+    double traceTime = double(_traceStep) * _stepSeconds;
+    if ( _windPlant >= 0 && _windTrace ){
+        double windPower = _windTrace->get_value(traceTime, _traceInterpolate);
+        LOGDBG("Setting max wind to:  %f", windPower);
+        _step.maxCapacity[_windPlant] = windPower;
+        if ( setMinimum )
+            _step.minCapacity[_windPlant] = windPower;
     }
+    if ( _pvPlant >= 0 && _pvTrace ){
+        double pvPower = _pvTrace->get_value(traceTime, _traceInterpolate);
+        LOGDBG("Setting max solar to: %f", pvPower);
+        _step.maxCapacity[_pvPlant] = pvPower;
+        if ( setMinimum )
+            _step.minCapacity[_pvPlant] = pvPower;
+    }
+    _traceStep++;
+}
 
-    std::map<std::string, double> sourceProd;
-    int ret = run_optimization(numSources, runCosts, rampCosts, startUpCosts, minCapacity, maxCapacity,
-                            plantNames, plantNames_on, plantNames_prod, plantNames_indOn, plantNames_indProd,
-                            arrayLoc, demandPower, sourceProd);
 
-    std::shared_ptr<std::map<std::string, double>> prodValPtr;
-    std::map<std::string, double> *prodVals = new std::map<std::string, double>;
-    for (auto& src: _sourceNames)
-    {
-        (*prodVals)[src] = sourceProd[src];
+int
+UtilityManager::share_traces(UtilityManager const& other)
+{
+    _pvTrace   = other._pvTrace;
+    _windTrace = other._windTrace;
+    _traceStep = 0;
+
+    reserve_history();
+
+    return SUCCESS;
+}
+
+
+void
+UtilityManager::reserve_history()
+{
+    // Enough steps to run the trace through, so recording a step does not grow any series
+    size_t numSteps = 0;
+    if ( _pvTrace )
+        numSteps = (_pvTrace->size() * _pvTrace->get_sampleSeconds() + _stepSeconds - 1) / _stepSeconds;
+    _costValsTime.reserve(numSteps);
+    _prodValsTime.reserve(numSteps * _plants.size());
+    _emissions.reserve(numSteps);
+    _gridSignal->reserve(numSteps);
+}
+
+
+void
+UtilityManager::set_traceStep(int stepSeconds, bool interpolate)
+{
+    if ( stepSeconds <= 0 ){
+        PyErr_SetString(PyExc_ValueError, "Trace step must be a positive number of seconds");
+        bp::throw_error_already_set();
     }
-    set_power(*prodVals);
-    prodValPtr.reset(prodVals);
-    _prodValsTime.push_back(prodValPtr);
-    return ret;
+    // Step times are counted from the start so the length can not change part way through
+    if ( get_numSteps() > 0 ){
+        PyErr_SetString(PyExc_ValueError, "Trace step can only be set before the first step or after clear_memory");
+        bp::throw_error_already_set();
+    }
+
+    _stepSeconds      = stepSeconds;
+    _traceInterpolate = interpolate;
+    reserve_history();
 }
 
 
 int 
-UtilityManager::set_power(std::map<std::string, double> prod, bool overrideRamps)
+UtilityManager::set_power(double const* prod, bool overrideRamps)
 {
-    for (auto& src : prod)
+    for (size_t k = 0; k < _plants.size(); ++k)
     {
-        LOGDBG("Setting power for: %s to: %.2f", src.first.c_str(), src.second);
-        _sources[src.first]->set_powerPoint(src.second, overrideRamps);
-        LOGDBG("Power point for: %s to:vv %.2f", src.first.c_str(), _sources[src.first]->get_currPower());
+        LOGDBG("Setting power for: %s to: %.2f", _sourceNames[k].c_str(), prod[k]);
+        _plants.set_powerPoint(k, prod[k], overrideRamps);
+        LOGDBG("Power point for: %s to:vv %.2f", _sourceNames[k].c_str(), _plants.get_currPower(k));
     }
+
+    return SUCCESS;
 }
 
 
 bp::tuple
 UtilityManager::get_totalEmissions()
 {
-    EnergySource::Emissions totalEmissions = {
-        .carbonDioxide = 0,
-        .methane       = 0,
-        .nitrousOxide  = 0
+    Emissions totalEmissions = _emissions.get_total();
+
+    return bp::make_tuple(totalEmissions.carbonDioxide, totalEmissions.methane, totalEmissions.nitrousOxide);
+}
+
+
+bp::dict
+UtilityManager::get_emissionsStats()
+{
+    auto toTuple = [](Emissions const& emissions) {
+        return bp::make_tuple(emissions.carbonDioxide, emissions.methane, emissions.nitrousOxide);
+    };
+
+    bp::list daily;
+    auto const& days = _emissions.get_days();
+    auto const& dailyTotals = _emissions.get_dailyTotals();
+    for (size_t idx = 0; idx < days.size(); ++idx)
+        daily.append(bp::make_tuple(days[idx], dailyTotals[idx].carbonDioxide, dailyTotals[idx].methane, dailyTotals[idx].nitrousOxide));
+
+    bp::dict stats;
+    stats["total"]        = toTuple(_emissions.get_total());
+    stats["daily"]        = daily;
+    stats["busEnergy"]    = _emissions.get_busEnergy();
+    stats["busEmissions"] = toTuple(_emissions.get_busEmissions());
+    stats["busMarginal"]  = toTuple(_emissions.get_busMarginal());
+
+    return stats;
+}
+
+
+bp::dict
+UtilityManager::get_emissionsTime()
+{
+    size_t numSteps  = _emissions.get_numSteps();
+    size_t numPlants = _emissions.get_numPlants();
+    auto toArray = [numSteps, numPlants](std::vector<double> const& values) {
+        bpn::ndarray arr = bpn::zeros(bp::make_tuple(numSteps, numPlants), bpn::dtype::get_builtin<double>());
+        std::copy(values.begin(), values.end(), reinterpret_cast<double*>(arr.get_data()));
+        return arr;
     };
 
+    bpn::ndarray times = bpn::zeros(bp::make_tuple(numSteps), bpn::dtype::get_builtin<int32_t>());
+    std::copy(_emissions.get_times().begin(), _emissions.get_times().end(), reinterpret_cast<int32_t*>(times.get_data()));
+
+    bp::list plants;
     for (auto& src: _sourceNames)
+        plants.append(src);
+
+    bp::dict series;
+    series["times"]         = times;
+    series["plants"]        = plants;
+    series["carbonDioxide"] = toArray(_emissions.get_carbonDioxide());
+    series["methane"]       = toArray(_emissions.get_methane());
+    series["nitrousOxide"]  = toArray(_emissions.get_nitrousOxide());
+
+    return series;
+}
+
+
+void
+UtilityManager::record_marginal(double busPower)
+{
+    // Another MW goes to the cheapest running plant with room to ramp up, failing that the
+    // cheapest one that would have to start. Its cost and rate are what the buses add at the margin.
+    int marginal = -1;
+    bool marginalOn = false;
+    for (size_t k = 0; k < _plants.size(); ++k)
     {
-        totalEmissions += _sources[src]->get_emissionsOutput();
+        bool isOn = _sourcePrevState[k] == SourceState::e_SSON;
+        if ( _step.maxCapacity[k] - _plants.get_currPower(k) <= 1e-6 || (marginalOn && !isOn) )
+            continue;
+        if ( marginal < 0 || (isOn && !marginalOn) || _step.runCosts[k] < _step.runCosts[marginal] ){
+            marginal   = k;
+            marginalOn = isOn;
+        }
     }
 
-    return bp::make_tuple(totalEmissions.carbonDioxide, totalEmissions.methane, totalEmissions.nitrousOxide);
+    Emissions marginalRate = {0.0, 0.0, 0.0};
+    double marginalCost = 0.0;
+    if ( marginal >= 0 ){
+        marginalRate = _plants.get_emissionsRate(marginal);
+        marginalCost = _plants.get_powerCost(marginal);
+    }
+
+    int simTime = get_simTime();
+    _emissions.record(simTime, _stepSeconds, _plants.get_powers(), _plants.get_emissionsRates(), marginalRate, busPower);
+    _gridSignal->publish(simTime, marginalCost, marginalRate.carbonDioxide);
 }
 
 
 int
-UtilityManager::run_optimization(int numSources, double* runCosts, double* rampCosts, double* startupCosts, double* minCapacity, double* maxCapacity,
-                                 std::string* plantNames, std::string* plantNames_on, std::string* plantNames_prod, std::string* plantNames_indOn, std::string* plantNames_indProd,
-                                 std::map<std::string, int> arrayLoc, double demandPower, std::map<std::string, double>& sourceProd)
+UtilityManager::run_optimization(double demandPower)
 {
-    int k, optSuccess = 0;
-
-    double maxNegCapacity[numSources];
-    for (int i=0; i < numSources; i++){
-        maxNegCapacity[i] = -maxCapacity[i];
-    }
+    int k, optSuccess = SUCCESS;
+    int numSources = _plants.size();
+    int simTime = get_simTime();
+    double* runCosts     = _step.runCosts.data();
+    double* rampCosts    = _step.rampCosts.data();
+    double* startupCosts = _step.startupCosts.data();
+    double* minCapacity  = _step.minCapacity.data();
+    double* maxCapacity  = _step.maxCapacity.data();
 
     // Model
     GRBEnv* env        = 0;
@@ -285,12 +359,16 @@ UtilityManager::run_optimization(int numSources, double* runCosts, double* rampC
     GRBVar* production = 0;
     GRBVar* plantOn    = 0;
     try {
+        PROF::Clock::time_point buildStart = PROF::Clock::now();
+
         // Model
         env = new GRBEnv();
         GRBModel model = GRBModel(*env);
         env->set(GRB_IntParam_OutputFlag, 0);        
         model.set(GRB_StringAttr_ModelName, "startup");
         model.set(GRB_IntParam_OutputFlag, 0);
+        if ( _solveTimeLimit > 0.0 )
+            model.set(GRB_DoubleParam_TimeLimit, _solveTimeLimit);
 
         double zeros[numSources];
         double ones[numSources];
@@ -301,10 +379,10 @@ UtilityManager::run_optimization(int numSources, double* runCosts, double* rampC
         std::fill(types_bin, types_bin + numSources, GRB_BINARY);
         std::fill(types_cont, types_cont + numSources, GRB_CONTINUOUS);
 
-        production = model.addVars(minCapacity, maxCapacity, ones, types_cont, plantNames_prod, numSources);
-        plantOn    = model.addVars(zeros, ones, ones, types_bin, plantNames_on, numSources);
-        prodInd    = model.addVars(zeros, ones, ones, types_bin, plantNames_indProd, numSources);
-        onInd      = model.addVars(zeros, ones, ones, types_bin, plantNames_indOn, numSources);
+        production = model.addVars(minCapacity, maxCapacity, ones, types_cont, _names.prod.data(), numSources);
+        plantOn    = model.addVars(zeros, ones, ones, types_bin, _names.on.data(), numSources);
+        prodInd    = model.addVars(zeros, ones, ones, types_bin, _names.indProd.data(), numSources);
+        onInd      = model.addVars(zeros, ones, ones, types_bin, _names.indOn.data(), numSources);
 
         /** COST FUNCTION */
         /** J = Sum_k(Cost_k * Prod_k * On_k) */
@@ -314,10 +392,10 @@ UtilityManager::run_optimization(int numSources, double* runCosts, double* rampC
         GRBLinExpr on_a[numSources];
         GRBLinExpr on_b[numSources];
         for (k=0; k < numSources; ++k){
-            prod_a[k] = production[k] - _sourcePrevProduction[_sourceNames[k]];
-            prod_b[k] = _sourcePrevProduction[_sourceNames[k]] - production[k];
-            on_a[k]   = plantOn[k] - (int)_sourcePrevState[_sourceNames[k]];
-            on_b[k]   = (int)_sourcePrevState[_sourceNames[k]] - plantOn[k];
+            prod_a[k] = production[k] - _sourcePrevProduction[k];
+            prod_b[k] = _sourcePrevProduction[k] - production[k];
+            on_a[k]   = plantOn[k] - (int)_sourcePrevState[k];
+            on_b[k]   = (int)_sourcePrevState[k] - plantOn[k];
             costTotal += ( (runCosts[k] * production[k] * plantOn[k])
                       +    ((prod_a[k] * prodInd[k]) * rampCosts[k])
                       +    ((on_a[k] * onInd[k]) * minCapacity[k] * startupCosts[k]) );
@@ -328,20 +406,18 @@ UtilityManager::run_optimization(int numSources, double* runCosts, double* rampC
         /**  */
         GRBQuadExpr proTotal = 0;
         for (k=0; k < numSources; ++k){
-            if (plantNames[k].compare("Solar_(aggregated)_-_base_case") == 0)
-                model.addConstr(plantOn[k] == 1,                                plantNames[k] + "_SolarOn");
-            if (plantNames[k].compare("Wind_(aggregated)_-_base_case") == 0)
-                model.addConstr(plantOn[k] == 1,                                plantNames[k] + "_WindOn");
-            if (minCapacity[k] > _sources[_sourceNames[k]]->get_minOutputPower())
-                model.addConstr(plantOn[k] == 1,                                plantNames[k] + "_NoTurnOff");
+            if (k == _pvPlant || k == _windPlant)
+                model.addConstr(plantOn[k] == 1,                                _names.traceOn[k]);
+            if (minCapacity[k] > _plants.get_minOutputPower(k))
+                model.addConstr(plantOn[k] == 1,                                _names.noTurnOff[k]);
             proTotal += production[k] * plantOn[k];
-            model.addConstr((production[k] - maxCapacity[k]) <= 0,              plantNames[k] + "_NoOverProd");
-            model.addConstr((production[k] - minCapacity[k] * plantOn[k]) >= 0, plantNames[k] + "_OffOrGtMinCap");
-            model.addConstr( production[k] >= 0,                                plantNames[k] + "_ProdGtEZ");
-            model.addQConstr(prod_a[k] * prodInd[k] >= 0,                       plantNames[k] + "_prod_a");
-            model.addQConstr(prod_b[k] * (1-prodInd[k]) >= 0,                   plantNames[k] + "_prod_b");
-            model.addQConstr(on_a[k] * onInd[k] >= 0,                           plantNames[k] + "_on_a");
-            model.addQConstr(on_b[k] * (1-onInd[k]) >= 0,                       plantNames[k] + "_on_b");
+            model.addConstr((production[k] - maxCapacity[k]) <= 0,              _names.noOverProd[k]);
+            model.addConstr((production[k] - minCapacity[k] * plantOn[k]) >= 0, _names.offOrGtMinCap[k]);
+            model.addConstr( production[k] >= 0,                                _names.prodGtEZ[k]);
+            model.addQConstr(prod_a[k] * prodInd[k] >= 0,                       _names.prodA[k]);
+            model.addQConstr(prod_b[k] * (1-prodInd[k]) >= 0,                   _names.prodB[k]);
+            model.addQConstr(on_a[k] * onInd[k] >= 0,                           _names.onA[k]);
+            model.addQConstr(on_b[k] * (1-onInd[k]) >= 0,                       _names.onB[k]);
         }
         model.addQConstr(proTotal >= demandPower, "DemandConstraintMax");
         model.addQConstr(proTotal <= demandPower*1.05, "DemandConstraintMax");
@@ -350,78 +426,108 @@ UtilityManager::run_optimization(int numSources, double* runCosts, double* rampC
         // First, close all plants
         for (k = 0; k < numSources; ++k)
         {
-            plantOn[k].set(GRB_DoubleAttr_Start, (int)_sourcePrevState[_sourceNames[k]]);
+            plantOn[k].set(GRB_DoubleAttr_Start, (int)_sourcePrevState[k]);
         }
 
         model.update();
-        model.optimize();
+        {
+            static const int buildPhase = PROF::register_phase("model_build");
+            PROF::record(buildPhase, buildStart, PROF::Clock::now());
+        }
+        {
+            PROF_SCOPE("optimize");
+            model.optimize();
+        }
         //model.write("test.mps");
         //model.write("test.prm");
         //model.write("test.mst");
 
-        double totalPower = 0.0;
-        double totalCost = model.get(GRB_DoubleAttr_ObjVal);
-        _costValsTime.push_back(totalCost);
+        // A time limited solve is still usable when it found an incumbent
+        int status = model.get(GRB_IntAttr_Status);
+        if ( status == GRB_TIME_LIMIT )
+            _failures->record(EVLOG::eTIME_LIMITED_SOLVE, simTime, status, demandPower);
+        if ( status == GRB_INFEASIBLE || status == GRB_INF_OR_UNBD ){
+            _failures->record(EVLOG::eINFEASIBLE_SOLVE, simTime, status, demandPower);
+            optSuccess = FAILURE;
+        }
+        else if ( model.get(GRB_IntAttr_SolCount) == 0 ){
+            optSuccess = FAILURE;
+        }
 
-        LOGDBG("TOTAL COSTS: %f", totalCost);
-        LOGDBG("SOLUTION:");
-        for (k = 0; k < numSources; ++k)
-        {
-            std::stringstream ss;
-            if (plantOn[k].get(GRB_DoubleAttr_X) > 0.99)
-            {
-                double prodPower = production[k].get(GRB_DoubleAttr_X);
-
-                _sourcePrevProduction[plantNames[k]] = prodPower;
-                _sourcePrevState[plantNames[k]] = SourceState::e_SSON;
-                totalPower += production[k].get(GRB_DoubleAttr_X);
-                sourceProd.insert(std::pair<std::string, double>(plantNames[k], production[k].get(GRB_DoubleAttr_X)));
-                
-                ss << std::left << std::setw(40)
-                   << plantNames[k].c_str() << " open and producing: "
-                   << std::fixed << std::setprecision(2)
-                   << prodPower << "MW ("
-                   << 100*prodPower/maxCapacity[k]
-                   << "% Cap Factor)";
-            }
-            else
-            {
-                _sourcePrevProduction[plantNames[k]] = 0.0;
-                _sourcePrevState[plantNames[k]] = SourceState::e_SSOFF;
-                sourceProd.insert(std::pair<std::string, double>(plantNames[k], 0.0));
+        if ( optSuccess == SUCCESS ){
+            double totalPower = 0.0;
+            double totalCost = model.get(GRB_DoubleAttr_ObjVal);
 
-                ss << std::left << std::setw(40) << plantNames[k].c_str() 
-                   << " closed";
+            LOGDBG("TOTAL COSTS: %f", totalCost);
+            LOGDBG("SOLUTION:");
+            for (k = 0; k < numSources; ++k)
+            {
+                if (plantOn[k].get(GRB_DoubleAttr_X) > 0.99)
+                {
+                    double prodPower = production[k].get(GRB_DoubleAttr_X);
+
+                    _sourcePrevProduction[k] = prodPower;
+                    _sourcePrevState[k] = SourceState::e_SSON;
+                    totalPower += prodPower;
+                    _step.production[k] = prodPower;
+                    LOGDBG("%-40s open and producing: %.2fMW (%.2f%% Cap Factor)",
+                           _sourceNames[k].c_str(), prodPower, 100*prodPower/maxCapacity[k]);
+                }
+                else
+                {
+                    _sourcePrevProduction[k] = 0.0;
+                    _sourcePrevState[k] = SourceState::e_SSOFF;
+                    _step.production[k] = 0.0;
+                    LOGDBG("%-40s closed", _sourceNames[k].c_str());
+                }
             }
-
-            LOGDBG("%s", ss.str().c_str());
+            LOGDBG("Total Power Produced: %.2f", totalPower);
+            _costValsTime.push_back(totalCost);
         }
-        LOGDBG("Total Power Produced: %.2f", totalPower);
     }
     catch (GRBException e)
     {
         LOGERR("Error code = %i: %s", e.getErrorCode(), e.getMessage().c_str());
+        _failures->record(EVLOG::eSOLVER_ERROR, simTime, e.getErrorCode(), demandPower);
+        optSuccess = FAILURE;
     }
     catch (...)
     {
         LOGERR("Exception during optimization");
+        _failures->record(EVLOG::eSOLVER_ERROR, simTime, -1, demandPower);
+        optSuccess = FAILURE;
     }
 
+    if ( optSuccess != SUCCESS )
+        dispatch_fallback();
+
     return optSuccess;
 }
 
 
-double
-UtilityManager::get_currPower()
+void
+UtilityManager::dispatch_fallback()
 {
-    double currPower = 0.0;
-
-    for (auto& src: _sourceNames)
+    // Hold every plant where it was so the run continues and cost stays aligned with production
+    double heldPower = 0.0, heldCost = 0.0;
+    for (size_t k = 0; k < _plants.size(); ++k)
     {
-        currPower += _sources[src]->get_currPower();
+        double prodPower = _sourcePrevProduction[k];
+        _step.production[k] = prodPower;
+        heldPower += prodPower;
+        heldCost  += _step.runCosts[k] * prodPower;
     }
+    _costValsTime.push_back(heldCost);
 
-    return currPower;
+    LOGERR("No dispatch from solver, holding %.2f MW", heldPower);
+    _failures->record(EVLOG::eFALLBACK_DISPATCH, get_simTime(), 0, heldPower);
+}
+
+
+double
+UtilityManager::get_currPower()
+{
+    return _plants.get_currPower();
 }
 
 
@@ -444,7 +550,6 @@ UtilityManager::convert_toSources(bpn::ndarray const& sourceName, bpn::ndarray c
 
     for (int src = 0; src < dataLen; ++src)
     {
-        std::shared_ptr<EnergySource> eSrc;
         std::string name = std::string(bp::extract<char const *>(sourceName[src]));
         std::string type = std::string(bp::extract<char const *>(sourceType[src]));
         
@@ -465,56 +570,62 @@ UtilityManager::convert_toSources(bpn::ndarray const& sourceName, bpn::ndarray c
             .rampCost    = (double)rampCost[src],
             .startupCost = (double)startCost[src]
         };
-        enum EnergyFuels fuelType = fuelStringToEnum[type];
-
-        switch( fuelType ){
-        case eBIOMASS:
-            LOGDBG("Creating Biomass Plant: %s", name.c_str());
-            eSrc.reset(create_BiomassPlant(esp));
-            break;
-        case eCOAL:
-            LOGDBG("Creating Coal Plant: %s", name.c_str());
-            eSrc.reset(create_CoalPlant(esp));
-            break;
-        case eHYDRO:
-            LOGDBG("Creating Hydro Plant: %s", name.c_str());
-            eSrc.reset(create_HydroPlant(esp));
-            break;
-        case eNATURALGAS:
-            LOGDBG("Creating Natural Gas Plant: %s", name.c_str());
-            eSrc.reset(create_NaturalGasPlant(esp));
-            break;
-        case eNUCLEAR:
-            LOGDBG("Creating Nuclear Plant: %s", name.c_str());
-            eSrc.reset(create_NuclearPlant(esp));
-            break;
-        case eSOLAR:
-            LOGDBG("Creating Solar Plant: %s", name.c_str());
-            eSrc.reset(create_SolarPlant(this, esp));
-            break;
-        case eWIND:
-            LOGDBG("Creating Wind Plant: %s", name.c_str());
-            eSrc.reset(create_WindPlant(this, esp));
-            break;
-        default:
+        int fuelIdx = _plants.find_fuel(type);
+        if ( fuelIdx < 0 ){
             PyErr_SetString(PyExc_TypeError, "Facility Type is not supported");
             bp::throw_error_already_set();
         }
 
+        LOGDBG("Creating %s Plant: %s", type.c_str(), name.c_str());
+        int plant = _plants.add_plant(esp, fuelIdx);
+        if ( _plants.is_uncontrolled(plant) && name == solarTraceSource )
+            _pvPlant = plant;
+        if ( _plants.is_uncontrolled(plant) && name == windTraceSource )
+            _windPlant = plant;
         _sourceNames.push_back(name);
-        _sources.insert(std::pair<std::string, std::shared_ptr<EnergySource>>(name, eSrc)); 
-        _sourcePrevState[name] = SourceState::e_SSOFF;
-        _sourcePrevProduction[name] = 0.0;
+        _sourcePrevState.push_back(SourceState::e_SSOFF);
+        _sourcePrevProduction.push_back(0.0);
+
+        // Solver names are only built here so steps do not concatenate strings
+        _names.on.push_back(name + "_on");
+        _names.prod.push_back(name + "_cost");
+        _names.indOn.push_back(name + "_indOn");
+        _names.indProd.push_back(name + "_indProd");
+        _names.traceOn.push_back(name + (plant == _pvPlant ? "_SolarOn" : "_WindOn"));
+        _names.noTurnOff.push_back(name + "_NoTurnOff");
+        _names.noOverProd.push_back(name + "_NoOverProd");
+        _names.offOrGtMinCap.push_back(name + "_OffOrGtMinCap");
+        _names.prodGtEZ.push_back(name + "_ProdGtEZ");
+        _names.prodA.push_back(name + "_prod_a");
+        _names.prodB.push_back(name + "_prod_b");
+        _names.onA.push_back(name + "_on_a");
+        _names.onB.push_back(name + "_on_b");
     }
+
+    size_t numSources = _plants.size();
+    for (auto column: {&_step.runCosts, &_step.rampCosts, &_step.startupCosts, &_step.minCapacity, &_step.maxCapacity, &_step.production})
+        column->assign(numSources, 0.0);
+    _emissions.reset(numSources);
     return SUCCESS;
 }
 
 
-
 int
-UtilityManager::register_uncontrolledSource(std::string src)
+UtilityManager::set_fuelType(std::string name, double carbonDioxide, double methane, double nitrousOxide, bool uncontrolled)
 {
-    _ucSourceNames.push_back(src);
+    if ( carbonDioxide < 0.0 || methane < 0.0 || nitrousOxide < 0.0 ){
+        PyErr_SetString(PyExc_ValueError, "Emission rates are negative");
+        bp::throw_error_already_set();
+    }
+
+    // Names are matched after spaces become underscores, as they are for the sources file
+    std::replace(name.begin(), name.end(), ' ', '_');
+    int fuelIdx = _plants.find_fuel(name);
+    if ( fuelIdx >= 0 && _plants.get_fuel(fuelIdx).uncontrolled != uncontrolled && !_sourceNames.empty() ){
+        PyErr_SetString(PyExc_ValueError, "Plant types can not change between traced and dispatched after init");
+        bp::throw_error_already_set();
+    }
+    _plants.set_fuel(FuelType{name, {carbonDioxide, methane, nitrousOxide}, uncontrolled});
 
     return SUCCESS;
 }
@@ -523,23 +634,26 @@ UtilityManager::register_uncontrolledSource(std::string src)
 void
 UtilityManager::file_dump()
 {
+    PROF_SCOPE("UtilityManager::file_dump");
     std::ofstream outfile;
     outfile.open("output/utility_prod.csv");
 
+    // Columns follow source order, the history has a row of values per step
     outfile << ",";
-    for (auto& source: *_prodValsTime[0])
-        outfile << source.first << ",";
+    for (auto& source: _sourceNames)
+        outfile << source << ",";
     outfile << std::endl;
 
     int simTime = 16200;
-    for (auto& prodMap: _prodValsTime){
+    size_t numSources = _sourceNames.size();
+    for (size_t step = 0; step < get_numSteps(); ++step){
         outfile << simTime << ",";
-        for (auto& source: *prodMap){
-            outfile << source.second << ",";
+        for (size_t k = 0; k < numSources; ++k){
+            outfile << _prodValsTime[step * numSources + k] << ",";
         }
         outfile << std::endl;
 
-        simTime += 60;
+        simTime += _stepSeconds;
     }
     outfile.close();
 
@@ -547,9 +661,184 @@ UtilityManager::file_dump()
     simTime = 16200;
     for (auto& cost: _costValsTime){
         outfile << simTime << "," << cost << std::endl;
-        simTime += 60;
+        simTime += _stepSeconds;
+    }
+    outfile.close();
+
+    outfile.open("output/utility_emissions.csv");
+    outfile << ",carbonDioxide,methane,nitrousOxide,marginalCarbonDioxide" << std::endl;
+    auto const& marginalRates = _emissions.get_marginalRates();
+    for (size_t step = 0; step < _emissions.get_numSteps(); ++step){
+        Emissions emitted = _emissions.get_step(step);
+        outfile << _emissions.get_times()[step] << "," << emitted.carbonDioxide << "," << emitted.methane << ","
+                << emitted.nitrousOxide << "," << marginalRates[step].carbonDioxide << std::endl;
     }
     outfile.close();
+
+    PROF::write_trace();
+    EVLOG::flush();
+}
+
+
+bp::dict
+UtilityManager::get_stats()
+{
+    return PROF::stats_toDict();
+}
+
+
+void
+UtilityManager::set_traceFile(std::string path)
+{
+    PROF::set_traceFile(path);
+}
+
+
+bp::dict
+UtilityManager::get_eventCounts()
+{
+    return EVLOG::counts_toDict(*_events);
+}
+
+
+int
+UtilityManager::set_eventLog(std::string path)
+{
+    if ( path.empty() ){
+        EVLOG::close_file();
+        return SUCCESS;
+    }
+
+    return EVLOG::open_file(path);
+}
+
+
+bp::dict
+UtilityManager::get_failureCounts()
+{
+    return EVLOG::failures_toDict(*_failures);
+}
+
+
+bp::list
+UtilityManager::get_failureRecords()
+{
+    return EVLOG::failures_toList(*_failures);
+}
+
+
+std::string
+UtilityManager::save_state() const
+{
+    CKPT::Writer out("EBUTLCK1");
+    out.put<uint32_t>(_sourceNames.size());
+    for (size_t k = 0; k < _sourceNames.size(); ++k)
+    {
+        out.put_string(_sourceNames[k]);
+        out.put<double>(_sourcePrevProduction[k]);
+        out.put<int32_t>(_sourcePrevState[k]);
+        out.put<double>(_plants.get_currPower(k));
+        out.put<int32_t>(_plants.get_currState(k));
+    }
+
+    // Traces are inputs, only the position in them is written
+    out.put<uint32_t>(_pvTrace ? _pvTrace->size() : 0);
+    out.put<uint32_t>(_windTrace ? _windTrace->size() : 0);
+    out.put<uint64_t>(_traceStep);
+    out.put<int32_t>(_stepSeconds);
+    out.put_vector(_costValsTime);
+
+    // Production history is written a step at a time in source order
+    out.put<uint32_t>(get_numSteps());
+    for (auto& prod: _prodValsTime)
+        out.put<double>(prod);
+
+    out.put_vector(_gridSignal->get_samples());
+    _emissions.save_state(out);
+    _failures->save_state(out);
+
+    return out.get_blob();
+}
+
+
+int
+UtilityManager::restore_state(std::string const& blob)
+{
+    CKPT::Reader in(blob.data(), blob.size(), "EBUTLCK1");
+    int numSources = _sourceNames.size();
+    std::vector<double>  prevProd(numSources), currPower(numSources);
+    std::vector<int32_t> prevState(numSources), currState(numSources);
+
+    // Read into temporaries so a bad blob leaves this manager as it was
+    in.expect<uint32_t>(numSources);
+    for (int k = 0; k < numSources && in.good(); ++k)
+    {
+        std::string name;
+        in.get_string(name);
+        if ( name != _sourceNames[k] )
+            return -1;
+        in.get(prevProd[k]);
+        in.get(prevState[k]);
+        in.get(currPower[k]);
+        in.get(currState[k]);
+    }
+
+    uint64_t traceStep = 0;
+    in.expect<uint32_t>(_pvTrace ? _pvTrace->size() : 0);
+    in.expect<uint32_t>(_windTrace ? _windTrace->size() : 0);
+    in.get(traceStep);
+    in.expect<int32_t>(_stepSeconds); // Step times follow from the count, so the length must match
+
+    std::vector<double> costValsTime;
+    in.get_vector(costValsTime);
+
+    std::vector<double> prodValsTime;
+    uint32_t numSteps = 0;
+    in.get(numSteps);
+    prodValsTime.resize(size_t(numSteps) * numSources);
+    for (size_t idx = 0; idx < prodValsTime.size() && in.good(); ++idx)
+        in.get(prodValsTime[idx]);
+
+    std::vector<GridSample> signal;
+    in.get_vector(signal);
+    EmissionsLedger emissions;
+    emissions.reset(numSources);
+    if ( !in.good() || !emissions.restore_state(in) || !_failures->restore_state(in) )
+        return -1;
+
+    for (int k = 0; k < numSources; ++k)
+    {
+        _sourcePrevProduction[k] = prevProd[k];
+        _sourcePrevState[k] = static_cast<SourceState>(prevState[k]);
+        _plants.restore_powerPoint(k, currPower[k], static_cast<SourceState>(currState[k]));
+    }
+    _traceStep = traceStep;
+    _costValsTime.swap(costValsTime);
+    _prodValsTime.swap(prodValsTime);
+    _emissions = std::move(emissions);
+    _gridSignal->set_samples(std::move(signal));
+    reserve_history(); // Restored series only hold what was written
+
+    return SUCCESS;
+}
+
+
+bp::object
+UtilityManager::get_checkpoint() const
+{
+    return CKPT::blob_toBytes(save_state());
+}
+
+
+int
+UtilityManager::restore_checkpoint(bp::object const& blob)
+{
+    if ( restore_state(CKPT::bytes_toBlob(blob)) != SUCCESS ){
+        PyErr_SetString(PyExc_ValueError, "Checkpoint does not match this utility manager");
+        bp::throw_error_already_set();
+    }
+
+    return SUCCESS;
 }
 
 
@@ -568,10 +857,12 @@ UtilityManager::clear_memory()
 {
     _costValsTime.clear();
     _prodValsTime.clear();
-
-    for( auto& src: _sources ){
-        src.second->reset();
-    }
+    _traceStep = 0;
+    _emissions.reset(_sourceNames.size());
+    _gridSignal->reset();
+    _events->reset();
+    _failures->reset();
+    _plants.reset();
 }
 
 
@@ -588,19 +879,77 @@ int (NRG::UtilityManager::*init_uc)(bpn::ndarray const&, bpn::ndarray const&, bp
                                 bpn::ndarray const&) 
                                 = &NRG::UtilityManager::init;
 
+int
+startup_releaseGil(NRG::UtilityManager& utilityManager, double demandPower)
+{
+    ReleaseGil release;
+    return utilityManager.startup(demandPower);
+}
+
+
+int
+startup_busReleaseGil(NRG::UtilityManager& utilityManager, double demandPower, double busPower)
+{
+    ReleaseGil release;
+    return utilityManager.startup(demandPower, busPower);
+}
+
+
+int
+power_request_releaseGil(NRG::UtilityManager& utilityManager, double demandPower)
+{
+    ReleaseGil release;
+    return utilityManager.power_request(demandPower);
+}
+
+
+int
+power_request_busReleaseGil(NRG::UtilityManager& utilityManager, double demandPower, double busPower)
+{
+    ReleaseGil release;
+    return utilityManager.power_request(demandPower, busPower);
+}
+
+
 BOOST_PYTHON_MODULE(UtilityManager)
 {
     bpn::initialize();
     Py_Initialize();
 
+    // Phase timing is shared by the module's managers, so clearing it is not left to any one of them
+    bp::def("reset_stats", &PROF::reset);
+
+    bp::class_<NRG::GridSignal, std::shared_ptr<NRG::GridSignal>, boost::noncopyable>("GridSignal", bp::no_init)
+        .def("get_index",           &NRG::GridSignal::get_index)
+        .def("get_numSamples",      &NRG::GridSignal::get_numSamples)
+    ;
+
     bp::class_<NRG::UtilityManager>("UtilityManager")
         .def("init",                init)
         .def("init",                init_uc)
-        .def("startup",             &NRG::UtilityManager::startup)
-        .def("power_request",       &NRG::UtilityManager::power_request)
+        .def("startup",             startup_releaseGil)
+        .def("startup",             startup_busReleaseGil)
+        .def("power_request",       power_request_releaseGil)
+        .def("power_request",       power_request_busReleaseGil)
+        .def("share_traces",        &NRG::UtilityManager::share_traces)
+        .def("set_traceStep",       &NRG::UtilityManager::set_traceStep)
         .def("get_totalEmissions",  &NRG::UtilityManager::get_totalEmissions)
+        .def("get_emissionsStats",  &NRG::UtilityManager::get_emissionsStats)
+        .def("get_emissionsTime",   &NRG::UtilityManager::get_emissionsTime)
+        .def("get_gridSignal",      &NRG::UtilityManager::get_gridSignal)
+        .def("set_fuelType",        &NRG::UtilityManager::set_fuelType)
         .def("file_dump",           &NRG::UtilityManager::file_dump)
         .def("get_totalCost",       &NRG::UtilityManager::get_totalCost)
         .def("clear_memory",        &NRG::UtilityManager::clear_memory)
+        .def("get_stats",           &NRG::UtilityManager::get_stats)
+        .def("set_traceFile",       &NRG::UtilityManager::set_traceFile)
+        .def("get_eventCounts",     &NRG::UtilityManager::get_eventCounts)
+        .def("set_eventLog",        &NRG::UtilityManager::set_eventLog)
+        .def("get_failureCounts",   &NRG::UtilityManager::get_failureCounts)
+        .def("get_failureRecords",  &NRG::UtilityManager::get_failureRecords)
+        .def("is_infeasible",       &NRG::UtilityManager::is_infeasible)
+        .def("set_solveTimeLimit",  &NRG::UtilityManager::set_solveTimeLimit)
+        .def("get_checkpoint",      &NRG::UtilityManager::get_checkpoint)
+        .def("restore_checkpoint",  &NRG::UtilityManager::restore_checkpoint)
     ;
 }
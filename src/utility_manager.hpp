@@ -3,9 +3,14 @@
 
 #include <map>
 #include <vector>
+#include <algorithm>
 #include <string>
 #include <iostream>
-#include "energy_source.hpp"
+#include "plant_table.hpp"
+#include "failure_ledger.hpp"
+#include "emissions_ledger.hpp"
+#include "grid_signal.hpp"
+#include "renewable_trace.hpp"
 #include "gurobi_c++.h"
 #include <boost/python.hpp>
 #include <boost/python/numpy.hpp>
@@ -19,8 +24,6 @@ namespace NRG {
 class UtilityManager 
 {
 public:
-    using ProdPtr = std::shared_ptr<double>;
-
     UtilityManager();
     ~UtilityManager();
 
@@ -35,15 +38,40 @@ public:
             bpn::ndarray const& rampingCost, bpn::ndarray const& startingCost,
             bpn::ndarray const& pvProduction_MW, bpn::ndarray const& windProduction_MW);
 
-    int startup(double demandPower);
+    /** busPower is the MW of demandPower that is bus charging, it is only used for emissions */
+    int startup(double demandPower, double busPower = 0.0);
+
+    int power_request(double demandPower, double busPower = 0.0);
 
-    int power_request(double demandPower);
+    /** prod holds MW per plant in source order */
+    int set_power(double const* prod, bool overrideRamps = false);
 
-    int set_power(std::map<std::string, double> prod, bool overrideRamps = false);
+    /** Takes the solar and wind traces of another manager rather than a copy of its own */
+    int share_traces(UtilityManager const& other);
 
+    /**
+     * Seconds per dispatch step, below 60 for runs stepping faster than the minute trace samples.
+     * Step times, costs, ramp limits and emissions all follow it. With interpolate a step between
+     * samples blends the two. Only set before the first step.
+     */
+    void set_traceStep(int stepSeconds, bool interpolate);
+
+    /** CO2, CH4 and N2O emitted since the start of the run */
     bp::tuple get_totalEmissions();
 
-    int register_uncontrolledSource(std::string src);
+    /** Daily totals and marginal emissions per MWh of bus charging */
+    bp::dict get_emissionsStats();
+    /** Step times and a steps by plants array per gas, plants in source order */
+    bp::dict get_emissionsTime();
+
+    /** Marginal cost and emissions per step, hand it to BusManager.set_gridSignal */
+    std::shared_ptr<GridSignal> get_gridSignal() const {return _gridSignal;}
+
+    /**
+     * Adds a plant type or changes one, rates are per MWh and uncontrolled types follow the
+     * solar or wind trace. Types used by the sources file must be set before init.
+     */
+    int set_fuelType(std::string name, double carbonDioxide, double methane, double nitrousOxide, bool uncontrolled);
 
     void file_dump();
 
@@ -51,22 +79,76 @@ public:
 
     void clear_memory();
 
+    /**
+     * Per phase timing totals and histograms, summed over every manager of this module and never
+     * cleared by clear_memory. The module level reset_stats clears them. The trace is written
+     * by file_dump when set.
+     */
+    bp::dict get_stats();
+    void set_traceFile(std::string path);
+
+    /** This manager's counts per event type and this module's event file, an empty path closes it */
+    bp::dict get_eventCounts();
+    int set_eventLog(std::string path);
+
+    /** Per run failure counts and records, sweeps can stop once is_infeasible is true */
+    bp::dict get_failureCounts();
+    bp::list get_failureRecords();
+    bool is_infeasible() const {return _failures->is_infeasible();}
+
+    /** Wall clock limit per solve in seconds, 0 leaves the solver unlimited */
+    void set_solveTimeLimit(double seconds) {_solveTimeLimit = seconds;}
+
+    /**
+     * Everything that changes while running as a binary blob. A blob restores into a manager
+     * initialised from the same sources, including one that has run since.
+     */
+    std::string save_state() const;
+    int restore_state(std::string const& blob);
+    bp::object get_checkpoint() const;
+    int restore_checkpoint(bp::object const& blob);
+
 private:
-    std::vector<double> _pvProduction;
-    std::vector<double> _windProduction;
+    std::shared_ptr<RenewableTrace const> _pvTrace;
+    std::shared_ptr<RenewableTrace const> _windTrace;
+    size_t _traceStep;        /** Dispatch steps taken into the traces */
+    int    _stepSeconds;      /** Dispatch step length */
+    bool   _traceInterpolate;
     std::vector<std::string> _sourceNames;
-    std::vector<std::string> _ucSourceNames;
-    std::map<std::string, double> _sourcePrevProduction;
-    std::map<std::string, SourceState> _sourcePrevState;
-    std::map<std::string, std::shared_ptr<EnergySource>> _sources;
+    std::vector<double> _sourcePrevProduction;
+    std::vector<SourceState> _sourcePrevState;
+    PlantTable _plants;
+    int _pvPlant;   /** Plant following the solar trace, -1 if none */
+    int _windPlant; /** Plant following the wind trace, -1 if none  */
+    std::shared_ptr<EVLOG::EventCounter> _events;
+    std::shared_ptr<EVLOG::FailureLedger> _failures;
+    double _solveTimeLimit;
+    EmissionsLedger _emissions;
+    std::shared_ptr<GridSignal> _gridSignal;
+
+    /** Solver variable and constraint names per plant, built once at init */
+    struct PlantNames {
+        std::vector<std::string> on, prod, indOn, indProd, traceOn, noTurnOff, noOverProd,
+                                 offOrGtMinCap, prodGtEZ, prodA, prodB, onA, onB;
+    } _names;
+
+    /** Per plant bounds and result of the step being dispatched, sized at init */
+    struct StepBounds {
+        std::vector<double> runCosts, rampCosts, startupCosts, minCapacity, maxCapacity, production;
+    } _step;
 
     // Time Series Data
     std::vector<double> _costValsTime;
-    std::vector<std::shared_ptr<std::map<std::string, double>>> _prodValsTime;
-
-    int run_optimization(int numSources, double* runCosts, double* rampCosts, double* startupCosts, double* minCapacity, double* maxCapacity,
-                            std::string* plantNames, std::string* plantNames_on, std::string* plantNames_prod, std::string* plantNames_indOn, std::string* plantNames_indProd,
-                            std::map<std::string, int> arrayLoc, double demandPower, std::map<std::string, double>& sourceProd);
+    std::vector<double> _prodValsTime; /** Step major, a value per plant in source order */
+
+    size_t get_numSteps() const {return _prodValsTime.size() / std::max<size_t>(_sourceNames.size(), 1);}
+    /** Start of the step being dispatched */
+    int get_simTime() const {return 16200 + _stepSeconds*get_numSteps();}
+    void apply_traces(bool setMinimum);
+    void reserve_history();
+    int run_optimization(double demandPower);
+    void dispatch_fallback();
+    void record_marginal(double busPower);
     double get_currPower();
     int convert_toSources(bpn::ndarray const& sourceName, bpn::ndarray const& sourceType, 
                         bpn::ndarray const& maxCapacity, bpn::ndarray const& minCapacity,